@@ -0,0 +1,272 @@
+// Buzzer audio (see audio.h). The emulation thread never waits for the
+// device: when the ring is full the frame is dropped, and the audio thread
+// plays silence rather than letting the device run dry. Only file sinks,
+// which don't play in real time, make the emulation wait for room.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifdef HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+#include "audio.h"
+
+// Samples queued for a device at most, more only adds latency
+#define AUDIO_LATENCY (AUDIO_FRAME * 4)
+
+static void put_le(unsigned char *p, uint32_t value, int bytes)
+{
+	for(int i = 0; i < bytes; i++){
+		p[i] = value >> (i * 8);
+	}
+}
+
+// 44 bytes WAV header for mono 16 bits PCM
+static void wav_header(unsigned char *h, uint32_t data_bytes)
+{
+	memcpy(h, "RIFF", 4);
+	put_le(h + 4, data_bytes + 36, 4);
+	memcpy(h + 8, "WAVEfmt ", 8);
+	put_le(h + 16, 16, 4);
+	put_le(h + 20, 1, 2);					// PCM
+	put_le(h + 22, 1, 2);					// mono
+	put_le(h + 24, AUDIO_RATE, 4);
+	put_le(h + 28, AUDIO_RATE * 2, 4);		// bytes per second
+	put_le(h + 32, 2, 2);					// bytes per sample
+	put_le(h + 34, 16, 2);					// bits per sample
+	memcpy(h + 36, "data", 4);
+	put_le(h + 40, data_bytes, 4);
+}
+
+static bool write_all(int fd, const void *buf, size_t n)
+{
+	const char *p = buf;
+	while(n > 0){
+		ssize_t w = write(fd, p, n);
+		if(w <= 0){
+			return false;
+		}
+		p += w;
+		n -= w;
+	}
+	return true;
+}
+
+// Hands samples to the sink (blocks, audio thread only)
+static bool play(Audio *a, const int16_t *samples, size_t n)
+{
+#ifdef HAVE_ALSA
+	if(a->pcm != NULL){
+		while(n > 0){
+			snd_pcm_sframes_t w = snd_pcm_writei(a->pcm, samples, n);
+			if(w < 0){
+				if(snd_pcm_recover(a->pcm, w, 1) < 0){
+					return false;
+				}
+				continue;
+			}
+			samples += w;
+			n -= w;
+		}
+		return true;
+	}
+#endif
+	// Samples are in host order, WAV wants them little endian
+	unsigned char bytes[1024];
+	while(n > 0){
+		size_t count = n < sizeof(bytes) / 2 ? n : sizeof(bytes) / 2;
+		for(size_t i = 0; i < count; i++){
+			put_le(bytes + 2 * i, (uint16_t)samples[i], 2);
+		}
+		if(!write_all(a->fd, bytes, count * 2)){
+			return false;
+		}
+		a->data_bytes += count * 2;
+		samples += count;
+		n -= count;
+	}
+	return true;
+}
+
+// Whether the device is about to run out of samples
+static bool starving(Audio *a)
+{
+#ifdef HAVE_ALSA
+	if(a->pcm != NULL){
+		snd_pcm_sframes_t delay;
+		return snd_pcm_delay(a->pcm, &delay) < 0 || delay < AUDIO_FRAME / 2;
+	}
+#endif
+	return false;
+}
+
+static void *audio_thread(void *arg)
+{
+	Audio *a = arg;
+	static const int16_t silence[AUDIO_FRAME / 4];
+
+	while(1){
+		size_t tail = atomic_load_explicit(&a->tail, memory_order_relaxed);
+		size_t head = atomic_load_explicit(&a->head, memory_order_acquire);
+		size_t avail = head - tail;
+		if(avail == 0){
+			if(!atomic_load(&a->running)){
+				break;
+			}
+			if(starving(a)){
+				a->underruns++;
+				play(a, silence, sizeof(silence) / sizeof(silence[0]));
+			} else {
+				usleep(1000);
+			}
+			continue;
+		}
+
+		// Up to the end of the ring, the rest comes next time
+		size_t start = tail & (AUDIO_RING - 1);
+		if(avail > AUDIO_RING - start){
+			avail = AUDIO_RING - start;
+		}
+		if(!play(a, &a->ring[start], avail)){
+			atomic_store(&a->running, false);
+			break;
+		}
+		atomic_store_explicit(&a->tail, tail + avail, memory_order_release);
+	}
+	return NULL;
+}
+
+// Closes the device or finishes the WAV file
+static void close_sink(Audio *a)
+{
+#ifdef HAVE_ALSA
+	if(a->pcm != NULL){
+		snd_pcm_drain(a->pcm);
+		snd_pcm_close(a->pcm);
+	}
+#endif
+	if(a->fd >= 0){
+		if(a->seekable){
+			unsigned char header[44];
+			wav_header(header, a->data_bytes);
+			pwrite(a->fd, header, sizeof(header), 0);
+		}
+		if(a->fd != STDOUT_FILENO){
+			close(a->fd);
+		}
+	}
+	free(a);
+}
+
+// Opens a sink: "alsa", a WAV file name, or "-" for a WAV on standard
+// output. Returns NULL on failure.
+Audio *audio_open(const char *sink)
+{
+	Audio *a = calloc(1, sizeof(Audio));
+	assert(a != NULL);
+	a->fd = -1;
+
+	if(strcmp(sink, "alsa") == 0){
+#ifdef HAVE_ALSA
+		snd_pcm_t *pcm;
+		if(snd_pcm_open(&pcm, "default", SND_PCM_STREAM_PLAYBACK, 0) < 0){
+			free(a);
+			return NULL;
+		}
+		// 50 ms of device buffer, resampling allowed
+		if(snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16,
+				SND_PCM_ACCESS_RW_INTERLEAVED, 1, AUDIO_RATE, 1, 50000) < 0){
+			snd_pcm_close(pcm);
+			free(a);
+			return NULL;
+		}
+		a->pcm = pcm;
+#else
+		free(a);
+		return NULL;
+#endif
+	} else {
+		a->fd = strcmp(sink, "-") == 0 ? STDOUT_FILENO :
+			open(sink, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(a->fd < 0){
+			free(a);
+			return NULL;
+		}
+		// Pipes never learn the size, players read until the end
+		a->seekable = lseek(a->fd, 0, SEEK_CUR) == 0;
+		unsigned char header[44];
+		wav_header(header, a->seekable ? 0 : 0xFFFFFFFF - 36);
+		write_all(a->fd, header, sizeof(header));
+		a->lossless = true;
+	}
+
+	atomic_store(&a->running, true);
+	if(pthread_create(&a->thread, NULL, audio_thread, a) != 0){
+		close_sink(a);
+		return NULL;
+	}
+	return a;
+}
+
+// Plays what is left in the ring and closes the sink
+void audio_close(Audio *a)
+{
+	if(a == NULL){
+		return;
+	}
+	atomic_store(&a->running, false);
+	pthread_join(a->thread, NULL);
+	close_sink(a);
+}
+
+// Generates the samples of one 60 Hz frame: a square wave while the sound
+// timer runs, or the XO-CHIP pattern (1 bit per sample, 128 bits long)
+// played at 4000 * 2^((pitch - 64) / 48) bits per second once F002 loaded
+// one, even all zeros (silence).
+void audio_frame(Audio *a, const CPU *cpu)
+{
+	size_t head = atomic_load_explicit(&a->head, memory_order_relaxed);
+	size_t limit = a->lossless ? AUDIO_RING : AUDIO_LATENCY;
+	while(head - atomic_load_explicit(&a->tail, memory_order_acquire) +
+			AUDIO_FRAME > limit){
+		if(!a->lossless || !atomic_load(&a->running)){
+			a->overruns++;
+			return;
+		}
+		sched_yield();
+	}
+
+	bool pattern = cpu->has_pattern;
+	double step = pattern ?
+		4000.0 * pow(2.0, (cpu->pitch - 64) / 48.0) / AUDIO_RATE :
+		(double)AUDIO_TONE / AUDIO_RATE;
+
+	for(int i = 0; i < AUDIO_FRAME; i++){
+		int16_t sample = 0;
+		if(cpu->sound_timer > 0){
+			if(pattern){
+				int bit = (int)a->phase & 127;
+				sample = cpu->pattern[bit >> 3] >> (7 - (bit & 7)) & 1 ?
+					AUDIO_VOLUME : -AUDIO_VOLUME;
+			} else {
+				sample = a->phase - (int)a->phase < 0.5 ?
+					AUDIO_VOLUME : -AUDIO_VOLUME;
+			}
+			a->phase += step;
+			if(a->phase >= 128){
+				a->phase -= 128;
+			}
+		} else {
+			// Every beep starts on the same edge
+			a->phase = 0;
+		}
+		a->ring[(head + i) & (AUDIO_RING - 1)] = sample;
+	}
+	atomic_store_explicit(&a->head, head + AUDIO_FRAME, memory_order_release);
+}
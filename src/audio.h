@@ -0,0 +1,42 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "cpu.h"
+
+// Buzzer audio. The emulation thread generates the samples of every 60 Hz
+// frame into a lock-free ring (single producer, single consumer), an audio
+// thread hands them to the sink: ALSA (built with HAVE_ALSA) or a WAV file,
+// "-" for standard output (headless runs only, the terminal is drawn there
+// otherwise).
+#define AUDIO_RATE 44100
+#define AUDIO_FRAME (AUDIO_RATE / 60)	// samples per 60 Hz frame
+#define AUDIO_RING 8192					// ring size in samples (power of 2)
+#define AUDIO_TONE 440					// buzzer frequency in Hz
+#define AUDIO_VOLUME 0x2000
+
+typedef struct {
+	int16_t ring[AUDIO_RING];		// samples, in host order
+	atomic_size_t head;				// samples written (emulation thread)
+	atomic_size_t tail;				// samples played (audio thread)
+	atomic_bool running;
+	pthread_t thread;
+	double phase;					// position in the wave or pattern
+	bool lossless;					// file sinks: wait for room, never drop
+	int fd;							// WAV sink
+	bool seekable;					// WAV sizes can be fixed on close
+	uint32_t data_bytes;			// WAV samples written
+	void *pcm;						// ALSA sink
+	unsigned long overruns;			// frames dropped, the ring was full
+	unsigned long underruns;		// silences played, the ring was empty
+} Audio;
+
+Audio *audio_open(const char *sink);
+void audio_close(Audio *a);
+void audio_frame(Audio *a, const CPU *cpu);
+
+#endif
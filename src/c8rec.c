@@ -0,0 +1,680 @@
+// c8rec - ahead-of-time recompiler from CHIP-8 ROMs to C (see native.h)
+//
+//   c8rec <rom>... > native_roms.c
+//
+// Code is discovered from the entry point at 0x200 by following jumps,
+// calls (and the return addresses of their 00EE), skips and the Bnnn jumps
+// whose register is set to a constant earlier in the block (the jump still
+// checks it, the block may be entered past that). Every block becomes
+// straight C on the CPU struct with the semantics of the interpreter
+// (interp.h) for the ROM's quirk profile; display and extension
+// instructions call the profile's interpreter itself. Returns and computed
+// jumps go through a switch on pc, and whatever was never discovered is left
+// to the interpreter.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <libgen.h>
+
+#include "cpu.h"
+#include "quirks.h"
+#include "romlib.h"
+
+// What the translation does with an instruction
+typedef enum {
+	OP_BAD,			// unknown or exit, left to the interpreter
+	OP_NATIVE,		// translated
+	OP_STEP,		// run by the interpreter, falls through
+	OP_STORE,		// writes memory at I, falls through
+	OP_JUMP,		// 1NNN, 0NNN
+	OP_CALL,		// 2NNN
+	OP_RET,			// 00EE
+	OP_SKIP,		// 3XNN, 4XNN, 5XY0, 9XY0, EX9E, EXA1
+	OP_COMPUTED,	// BNNN
+	OP_WAIT,		// FX0A
+} OpKind;
+
+// A ROM being translated
+typedef struct {
+	unsigned char memory[MEMORY_SIZE];	// memory as the ROM is loaded
+	unsigned int end;					// first address past the ROM
+	Profile profile;
+	bool leader[MEMORY_SIZE];			// a block starts here
+	bool seen[MEMORY_SIZE];				// decoded as an instruction
+	unsigned char code[MEMORY_SIZE / 8];	// bytes of translated instructions
+} Program;
+
+static Program prog;
+static unsigned short work[MEMORY_SIZE];
+static int work_top;
+
+static unsigned short fetch(Program *p, unsigned int addr)
+{
+	return p->memory[addr & 0xFFFF] << 8 | p->memory[(addr + 1) & 0xFFFF];
+}
+
+static OpKind classify(Program *p, unsigned short opcode)
+{
+	bool schip = p->profile == PROFILE_SCHIP || p->profile == PROFILE_XOCHIP;
+	bool xochip = p->profile == PROFILE_XOCHIP;
+	unsigned int NN = opcode & 0xFF;
+
+	switch(opcode & 0xF000){
+		case 0x0000:
+			if(NN == 0xE0){
+				return OP_NATIVE;
+			}
+			if(NN == 0xEE){
+				return OP_RET;
+			}
+			if(schip && NN == 0xFD){
+				return OP_BAD;
+			}
+			if(schip && (NN == 0xFB || NN == 0xFC || NN == 0xFE || NN == 0xFF ||
+					(opcode & 0xFFF0) == 0x00C0)){
+				return OP_STEP;
+			}
+			if(xochip && (opcode & 0xFFF0) == 0x00D0){
+				return OP_STEP;
+			}
+			return OP_JUMP;
+		case 0x1000: return OP_JUMP;
+		case 0x2000: return OP_CALL;
+		case 0x3000:
+		case 0x4000:
+		case 0x9000:
+			return OP_SKIP;
+		case 0x5000:
+			if(xochip && (opcode & 0xF) == 0x2){
+				return OP_STORE;
+			}
+			if(xochip && (opcode & 0xF) == 0x3){
+				return OP_STEP;
+			}
+			return OP_SKIP;
+		case 0x6000:
+		case 0x7000:
+		case 0xa000:
+		case 0xc000:
+			return OP_NATIVE;
+		case 0x8000:
+			switch(opcode & 0xF){
+				case 0x0: case 0x1: case 0x2: case 0x3:
+				case 0x4: case 0x5: case 0x6: case 0x7: case 0xE:
+					return OP_NATIVE;
+			}
+			return OP_BAD;
+		case 0xb000: return OP_COMPUTED;
+		case 0xd000: return OP_STEP;
+		case 0xe000:
+			return NN == 0x9E || NN == 0xA1 ? OP_SKIP : OP_BAD;
+		case 0xf000:
+			switch(NN){
+				case 0x07: case 0x15: case 0x18: case 0x1E: case 0x29: case 0x65:
+					return OP_NATIVE;
+				case 0x33: case 0x55:
+					return OP_STORE;
+				case 0x0A:
+					return OP_WAIT;
+				case 0x30:
+					return schip ? OP_NATIVE : OP_BAD;
+				case 0x75: case 0x85:
+					return schip ? OP_STEP : OP_BAD;
+				case 0x00:
+					return xochip && opcode == 0xF000 ? OP_STEP : OP_BAD;
+				case 0x01: case 0x02: case 0x3A:
+					return xochip ? OP_STEP : OP_BAD;
+			}
+			return OP_BAD;
+	}
+	return OP_BAD;
+}
+
+// Size of the instruction at addr (F000 NNNN is 4 bytes long)
+static unsigned int length(Program *p, unsigned int addr)
+{
+	return p->profile == PROFILE_XOCHIP && fetch(p, addr) == 0xF000 ? 4 : 2;
+}
+
+// Distance jumped by a skip at addr, same as SKIP_LENGTH in interp.h
+static unsigned int skip_length(Program *p, unsigned int addr)
+{
+	return p->profile == PROFILE_XOCHIP && fetch(p, addr + 2) == 0xF000 ? 6 : 4;
+}
+
+// Whether the instruction at addr lies in the ROM and can be translated
+static bool translatable(Program *p, unsigned int addr)
+{
+	return addr >= 0x200 && addr + length(p, addr) <= p->end &&
+		classify(p, fetch(p, addr)) != OP_BAD;
+}
+
+static bool terminates(OpKind kind)
+{
+	return kind >= OP_JUMP;
+}
+
+static void add_leader(Program *p, unsigned int addr)
+{
+	addr &= 0xFFFF;
+	if(!p->leader[addr]){
+		p->leader[addr] = true;
+		work[work_top++] = addr;
+	}
+}
+
+// Follows the control flow from every leader on the work list
+static void discover(Program *p)
+{
+	while(work_top > 0){
+		unsigned int addr = work[--work_top];
+		while(translatable(p, addr) && !p->seen[addr]){
+			unsigned short opcode = fetch(p, addr);
+			p->seen[addr] = true;
+			switch(classify(p, opcode)){
+				case OP_JUMP:
+					add_leader(p, opcode & 0x0FFF);
+					break;
+				case OP_CALL:
+					add_leader(p, opcode & 0x0FFF);
+					add_leader(p, addr + 2);
+					break;
+				case OP_SKIP:
+					add_leader(p, addr + 2);
+					add_leader(p, addr + skip_length(p, addr));
+					break;
+				case OP_WAIT:
+					// Runs again until a key is pressed
+					p->leader[addr] = true;
+					add_leader(p, addr + 2);
+					break;
+				default:
+					break;
+			}
+			if(terminates(classify(p, opcode))){
+				break;
+			}
+			addr = (addr + length(p, addr)) & 0xFFFF;
+		}
+	}
+}
+
+// Collects the instructions of the block starting at addr
+static int block(Program *p, unsigned int addr, unsigned int *addrs)
+{
+	int count = 0;
+	do {
+		if(!translatable(p, addr)){
+			break;
+		}
+		addrs[count++] = addr;
+		if(terminates(classify(p, fetch(p, addr)))){
+			break;
+		}
+		addr = (addr + length(p, addr)) & 0xFFFF;
+	} while(!p->leader[addr]);
+	return count;
+}
+
+// Target of the Bnnn ending a block when its register was set by 6XNN in
+// the block, or -1
+static int resolve(Program *p, unsigned int *addrs, int count)
+{
+	int known[16];
+	for(int r = 0; r < 16; r++){
+		known[r] = -1;
+	}
+
+	for(int i = 0; i < count - 1; i++){
+		unsigned short opcode = fetch(p, addrs[i]);
+		unsigned int X = opcode >> 8 & 0xF;
+		switch(opcode & 0xF000){
+			case 0x6000:
+				known[X] = opcode & 0xFF;
+				break;
+			case 0x7000:
+			case 0xc000:
+				known[X] = -1;
+				break;
+			case 0x8000:
+				known[X] = -1;
+				known[0xF] = -1;
+				break;
+			case 0xf000:
+				if((opcode & 0xFF) == 0x07){
+					known[X] = -1;
+				} else if((opcode & 0xFF) == 0x65){
+					for(int r = 0; r <= X; r++){
+						known[r] = -1;
+					}
+				} else if(classify(p, opcode) == OP_STEP){
+					for(int r = 0; r < 16; r++){
+						known[r] = -1;
+					}
+				}
+				break;
+			default:
+				if(classify(p, opcode) == OP_STEP){
+					for(int r = 0; r < 16; r++){
+						known[r] = -1;
+					}
+				}
+		}
+	}
+
+	unsigned short opcode = fetch(p, addrs[count - 1]);
+	if(classify(p, opcode) != OP_COMPUTED){
+		return -1;
+	}
+	bool jump_vx = p->profile == PROFILE_CHIP48 || p->profile == PROFILE_SCHIP;
+	int r = jump_vx ? opcode >> 8 & 0xF : 0;
+	return known[r] < 0 ? -1 : (known[r] + (opcode & 0x0FFF)) & 0xFFFF;
+}
+
+static void emit_goto(Program *p, unsigned int target, const char *indent)
+{
+	target &= 0xFFFF;
+	if(p->leader[target] && translatable(p, target)){
+		printf("%sgoto L_%04x;\n", indent, target);
+	} else {
+		printf("%schip8->pc = 0x%04x;\n%sreturn n;\n", indent, target, indent);
+	}
+}
+
+// Name of the Profile constant, as written in quirks.h
+static const char *profile_macro(Profile profile)
+{
+	static char macro[32];
+	snprintf(macro, sizeof(macro), "PROFILE_%s", profile_names[profile]);
+	for(char *c = macro; *c; c++){
+		*c = toupper(*c);
+	}
+	return macro;
+}
+
+// Hands the instruction at addr to the profile's interpreter
+static void emit_step(Program *p, unsigned int addr)
+{
+	printf("\tchip8->pc = 0x%04x;\n\tcpu_steps[%s](chip8);\n", addr,
+			profile_macro(p->profile));
+}
+
+// Stores check they don't write over translated code first
+static void emit_store_check(int rom, unsigned int addr, const char *len,
+		int left)
+{
+	printf("\tif(native_covers(code_%d, chip8->I, %s)){\n", rom, len);
+	printf("\t\tchip8->pc = 0x%04x;\n\t\t*stale = true;\n", addr);
+	printf("\t\treturn n + %d;\n\t}\n", left);
+}
+
+// Same semantics as interp.h, with the quirks of the profile resolved
+static void emit_native(Program *p, unsigned short opcode)
+{
+	unsigned int X = opcode >> 8 & 0xF;
+	unsigned int Y = opcode >> 4 & 0xF;
+	unsigned int NN = opcode & 0xFF;
+	unsigned int NNN = opcode & 0x0FFF;
+	bool vf_reset = p->profile == PROFILE_VIP;
+	bool shift_vy = p->profile == PROFILE_VIP || p->profile == PROFILE_XOCHIP;
+
+	switch(opcode & 0xF000){
+		case 0x0000:
+			printf("\tgfx_clear(chip8);\n");
+			break;
+		case 0x6000:
+			printf("\tV[%d] = 0x%02x;\n", X, NN);
+			break;
+		case 0x7000:
+			printf("\tV[%d] += 0x%02x;\n", X, NN);
+			break;
+		case 0x8000:
+			switch(opcode & 0xF){
+				case 0x0:
+					printf("\tV[%d] = V[%d];\n", X, Y);
+					break;
+				case 0x1:
+				case 0x2:
+				case 0x3:
+					printf("\tV[%d] %c= V[%d];\n", X, "|&^"[(opcode & 0xF) - 1], Y);
+					if(vf_reset){
+						printf("\tV[15] = 0;\n");
+					}
+					break;
+				case 0x4:
+					printf("\tV[15] = V[%d] > 0 && V[%d] > (0xFF - V[%d]);\n",
+							X, Y, X);
+					printf("\tV[%d] += V[%d];\n", X, Y);
+					break;
+				case 0x5:
+					printf("\tV[15] = !(V[%d] < V[%d]);\n", X, Y);
+					printf("\tV[%d] -= V[%d];\n", X, Y);
+					break;
+				case 0x6:
+					if(shift_vy){
+						printf("\tV[15] = V[%d] & 0x1;\n\tV[%d] = V[%d] >> 1;\n",
+								Y, X, Y);
+					} else {
+						printf("\tV[15] = V[%d] & 0x1;\n\tV[%d] >>= 1;\n", X, X);
+					}
+					break;
+				case 0x7:
+					printf("\tV[15] = !(V[%d] > V[%d]);\n", X, Y);
+					printf("\tV[%d] = V[%d] - V[%d];\n", X, Y, X);
+					break;
+				case 0xE:
+					if(shift_vy){
+						printf("\tV[15] = V[%d] >> 0x7;\n\tV[%d] = V[%d] << 1;\n",
+								Y, X, Y);
+					} else {
+						printf("\tV[15] = V[%d] >> 0x7;\n\tV[%d] <<= 1;\n", X, X);
+					}
+					break;
+			}
+			break;
+		case 0xa000:
+			printf("\tchip8->I = 0x%03x;\n", NNN);
+			break;
+		case 0xc000:
+			printf("\tV[%d] = (cpu_random(chip8) %% 0xFF) & 0x%02x;\n", X,
+					NN);
+			break;
+		case 0xf000:
+			switch(NN){
+				case 0x07:
+					printf("\tV[%d] = chip8->delay_timer;\n", X);
+					break;
+				case 0x15:
+					printf("\tchip8->delay_timer = V[%d];\n", X);
+					break;
+				case 0x18:
+					printf("\tchip8->sound_timer = V[%d];\n", X);
+					break;
+				case 0x1E:
+					printf("\tchip8->I += V[%d];\n", X);
+					break;
+				case 0x29:
+					printf("\tchip8->I = FONT_SMALL + ((V[%d] & 0xF) << 4);\n", X);
+					break;
+				case 0x30:
+					printf("\tchip8->I = FONT_BIG + (V[%d] & 0xF) * 10;\n", X);
+					break;
+				case 0x33:
+					printf("\tchip8->memory[chip8->I] = V[%d] / 100;\n", X);
+					printf("\tchip8->memory[(chip8->I + 1) & 0xFFFF] = "
+							"(V[%d] %% 100) / 10;\n", X);
+					printf("\tchip8->memory[(chip8->I + 2) & 0xFFFF] = "
+							"V[%d] %% 10;\n", X);
+					break;
+				case 0x55:
+				case 0x65:
+					{
+					unsigned int moved = p->profile == PROFILE_SCHIP ? 0 :
+						p->profile == PROFILE_CHIP48 ? X : X + 1;
+					for(unsigned int i = 0; i <= X; i++){
+						if(NN == 0x55){
+							printf("\tchip8->memory[(chip8->I + %d) & 0xFFFF] = "
+									"V[%d];\n", i, i);
+						} else {
+							printf("\tV[%d] = chip8->memory[(chip8->I + %d) & "
+									"0xFFFF];\n", i, i);
+						}
+					}
+					if(moved != 0){
+						printf("\tchip8->I += %d;\n", moved);
+					}
+					break;
+					}
+			}
+			break;
+	}
+}
+
+// Skip condition of 3XNN, 4XNN, 5XY0, 9XY0, EX9E and EXA1
+static void emit_skip_condition(unsigned short opcode)
+{
+	unsigned int X = opcode >> 8 & 0xF;
+	unsigned int Y = opcode >> 4 & 0xF;
+	switch(opcode & 0xF000){
+		case 0x3000: printf("V[%d] == 0x%02x", X, opcode & 0xFF); break;
+		case 0x4000: printf("V[%d] != 0x%02x", X, opcode & 0xFF); break;
+		case 0x5000: printf("V[%d] == V[%d]", X, Y); break;
+		case 0x9000: printf("V[%d] != V[%d]", X, Y); break;
+		case 0xe000:
+			printf("chip8->input[V[%d] & 0xF] %s 0x0", X,
+					(opcode & 0xFF) == 0x9E ? "!=" : "==");
+			break;
+	}
+}
+
+static void emit_block(Program *p, int rom, unsigned int *addrs, int count,
+		int *resolved)
+{
+	printf("L_%04x:\n", addrs[0]);
+	printf("\tif(n < %d){\n\t\tchip8->pc = 0x%04x;\n\t\treturn n;\n\t}\n",
+			count, addrs[0]);
+	printf("\tn -= %d;\n", count);
+
+	for(int i = 0; i < count; i++){
+		unsigned int addr = addrs[i];
+		unsigned short opcode = fetch(p, addr);
+		unsigned int X = opcode >> 8 & 0xF;
+		unsigned int Y = opcode >> 4 & 0xF;
+		for(unsigned int b = 0; b < length(p, addr); b++){
+			unsigned int a = (addr + b) & 0xFFFF;
+			p->code[a >> 3] |= 1 << (a & 7);
+		}
+
+		if(i > 0){
+			printf("I_%04x:\n", addr);
+		}
+		printf("\t// %04x: %04x\n", addr, opcode);
+		switch(classify(p, opcode)){
+			case OP_NATIVE:
+				emit_native(p, opcode);
+				break;
+			case OP_STEP:
+				emit_step(p, addr);
+				break;
+			case OP_STORE:
+				{
+				char len[16];
+				if((opcode & 0xF000) == 0x5000){
+					snprintf(len, sizeof(len), "%d", (X > Y ? X - Y : Y - X) + 1);
+					emit_store_check(rom, addr, len, count - i);
+					emit_step(p, addr);
+				} else {
+					snprintf(len, sizeof(len), "%d",
+							(opcode & 0xFF) == 0x33 ? 3 : X + 1);
+					emit_store_check(rom, addr, len, count - i);
+					emit_native(p, opcode);
+				}
+				break;
+				}
+			case OP_JUMP:
+				emit_goto(p, opcode & 0x0FFF, "\t");
+				break;
+			case OP_CALL:
+				printf("\tif(!push_stack(0x%04x, chip8)){\n\t\tassert(false);\n\t}\n",
+						(addr + 2) & 0xFFFF);
+				emit_goto(p, opcode & 0x0FFF, "\t");
+				break;
+			case OP_RET:
+				printf("\tchip8->pc = pop_stack(chip8);\n");
+				printf("\tassert(chip8->pc != 0xffff);\n\tgoto dispatch;\n");
+				break;
+			case OP_SKIP:
+				printf("\tif(");
+				emit_skip_condition(opcode);
+				printf("){\n");
+				emit_goto(p, addr + skip_length(p, addr), "\t\t");
+				printf("\t}\n");
+				emit_goto(p, addr + 2, "\t");
+				break;
+			case OP_COMPUTED:
+				{
+				int target = resolve(p, addrs, count);
+				bool jump_vx = p->profile == PROFILE_CHIP48 ||
+					p->profile == PROFILE_SCHIP;
+				printf("\tchip8->pc = V[%d] + 0x%03x;\n", jump_vx ? X : 0,
+						opcode & 0x0FFF);
+				if(target >= 0){
+					// The block may have been entered past the 6XNN, the
+					// register is checked before going there directly
+					printf("\tif(chip8->pc == 0x%04x){\n", target);
+					emit_goto(p, target, "\t\t");
+					printf("\t}\n");
+					(*resolved)++;
+				}
+				printf("\tgoto dispatch;\n");
+				break;
+				}
+			case OP_WAIT:
+				emit_step(p, addr);
+				printf("\tgoto dispatch;\n");
+				break;
+			case OP_BAD:
+				break;
+		}
+	}
+
+	// Falls through into the next block
+	unsigned int last = addrs[count - 1];
+	if(!terminates(classify(p, fetch(p, last)))){
+		emit_goto(p, last + length(p, last), "\t");
+	}
+}
+
+// Translates a ROM into code_<rom>, run_<rom> and native_<rom>
+static void translate(ROM *r, int rom)
+{
+	Program *p = &prog;
+	memset(p, 0x0, sizeof(*p));
+	memcpy(&p->memory[0x200], r->data, r->size);
+	p->end = 0x200 + r->size;
+	int profile = profile_from_name(r->profile);
+	p->profile = profile >= 0 ? profile : PROFILE_CHIP48;
+
+	// Resolved computed jumps bring in more code, until nothing new comes
+	static unsigned int addrs[MEMORY_SIZE];
+	add_leader(p, 0x200);
+	bool grown = true;
+	while(grown){
+		discover(p);
+		grown = false;
+		for(unsigned int a = 0x200; a < p->end; a++){
+			if(!p->leader[a] || !translatable(p, a)){
+				continue;
+			}
+			int count = block(p, a, addrs);
+			int target = resolve(p, addrs, count);
+			if(target >= 0 && !p->leader[target]){
+				add_leader(p, target);
+				grown = true;
+			}
+		}
+	}
+
+	printf("\n// %s (%s)\n", r->name, profile_names[p->profile]);
+	printf("static const unsigned char code_%d[MEMORY_SIZE / 8];\n\n", rom);
+	printf("static int run_%d(CPU *chip8, int n, bool *stale)\n{\n", rom);
+	printf("\tunsigned char *V = chip8->V;\n\n");
+	// Returns, waits and Bnnn go back through the switch (a resolved one
+	// when the register isn't what it was resolved with)
+	for(unsigned int a = 0x200; a < p->end; a++){
+		if(!p->leader[a] || !translatable(p, a)){
+			continue;
+		}
+		int count = block(p, a, addrs);
+		OpKind kind = classify(p, fetch(p, addrs[count - 1]));
+		if(kind == OP_RET || kind == OP_WAIT || kind == OP_COMPUTED){
+			printf("dispatch:\n");
+			break;
+		}
+	}
+	// Every instruction is an entry: a frame that ended in the middle of a
+	// block picks up from there with what is left of the block
+	printf("\tswitch(chip8->pc){\n");
+	for(unsigned int a = 0x200; a < p->end; a++){
+		if(!p->leader[a] || !translatable(p, a)){
+			continue;
+		}
+		int count = block(p, a, addrs);
+		printf("\t\tcase 0x%04x: goto L_%04x;\n", a, a);
+		for(int i = 1; i < count; i++){
+			printf("\t\tcase 0x%04x:\n", addrs[i]);
+			printf("\t\t\tif(n < %d){\n\t\t\t\treturn n;\n\t\t\t}\n",
+					count - i);
+			printf("\t\t\tn -= %d;\n\t\t\tgoto I_%04x;\n", count - i, addrs[i]);
+		}
+	}
+	printf("\t\tdefault: return n;\n\t}\n");
+
+	int blocks = 0, instructions = 0, computed = 0, resolved = 0;
+	for(unsigned int a = 0x200; a < p->end; a++){
+		if(!p->leader[a] || !translatable(p, a)){
+			continue;
+		}
+		int count = block(p, a, addrs);
+		printf("\n");
+		emit_block(p, rom, addrs, count, &resolved);
+		blocks++;
+		instructions += count;
+		if(classify(p, fetch(p, addrs[count - 1])) == OP_COMPUTED){
+			computed++;
+		}
+	}
+	printf("}\n\n");
+
+	// Translated bytes, self-modifying code is caught with it
+	printf("static const unsigned char code_%d[MEMORY_SIZE / 8] = {\n", rom);
+	for(unsigned int i = 0; i < MEMORY_SIZE / 8; i++){
+		if(p->code[i] != 0){
+			printf("\t[0x%04x] = 0x%02x,\n", i, p->code[i]);
+		}
+	}
+	printf("};\n\n");
+	printf("static const NativeROM native_%d = {\n", rom);
+	printf("\t0x%016llxULL, \"%s\", %s, code_%d, run_%d\n};\n",
+			(unsigned long long)r->hash, r->name, profile_macro(p->profile),
+			rom, rom);
+
+	fprintf(stderr, "%s (%s): %d blocks, %d instructions, %d/%d computed "
+			"jumps resolved\n", r->name, profile_names[p->profile], blocks,
+			instructions, resolved, computed);
+}
+
+int main(int argc, char **argv)
+{
+	if(argc < 2){
+		fprintf(stderr, "Usage: c8rec <rom>... > native_roms.c\n");
+		return 1;
+	}
+
+	printf("// Generated by c8rec, do not edit.\n");
+	printf("#include <assert.h>\n#include <stdlib.h>\n\n#include \"native.h\"\n");
+
+	// ROMs go through their library, so the profile is the one yac8e picks
+	for(int i = 1; i < argc; i++){
+		char dir[4096], base[4096];
+		snprintf(dir, sizeof(dir), "%s", argv[i]);
+		snprintf(base, sizeof(base), "%s", argv[i]);
+		ROMLibrary *lib = romlib_open(dirname(dir), false);
+		int r = lib != NULL ? romlib_find(lib, basename(base)) : -1;
+		if(r < 0){
+			fprintf(stderr, "%s is not a valid ROM\n", argv[i]);
+			return 1;
+		}
+		translate(&lib->roms[r], i);
+		romlib_close(lib);
+	}
+
+	printf("\nconst NativeROM *native_roms[] = {\n");
+	for(int i = 1; i < argc; i++){
+		printf("\t&native_%d,\n", i);
+	}
+	printf("\tNULL\n};\n");
+	return 0;
+}
@@ -0,0 +1,119 @@
+// c8view - watches the frames published by `yac8e -s` in a terminal
+//
+//   c8view [-r ansi|half|braille] <socket path | port>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "cpu.h"
+#include "render.h"
+#include "stream.h"
+
+// Set by ^C or SIGTERM, the viewer stops after the frame being read
+static volatile sig_atomic_t quit_requested;
+
+static void quit(int sig)
+{
+	quit_requested = 1;
+}
+
+// Reads exactly n bytes. Returns false at the end of the stream, or once
+// asked to quit.
+static bool read_full(int fd, unsigned char *buf, size_t n)
+{
+	while(n > 0){
+		ssize_t r = read(fd, buf, n);
+		if(r < 0 && errno == EINTR && !quit_requested){
+			continue;
+		}
+		if(r <= 0){
+			return false;
+		}
+		buf += r;
+		n -= r;
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	RenderMode mode = RENDER_HALF;
+	int opt;
+	while((opt = getopt(argc, argv, "r:")) != -1){
+		switch(opt){
+			case 'r':
+				{
+				int m = render_from_name(optarg);
+				if(m < 0 || m == RENDER_CURSES){
+					printf("Unknown renderer %s\n", optarg);
+					return 1;
+				}
+				mode = m;
+				break;
+				}
+			default:
+				optind = argc;
+		}
+	}
+	if(optind != argc - 1){
+		printf("Usage: c8view {-r ansi|half|braille} <socket path | port>\n");
+		return 1;
+	}
+
+	int fd = stream_connect(argv[optind]);
+	if(fd < 0){
+		perror(argv[optind]);
+		return 1;
+	}
+	// Without SA_RESTART, a read waiting for the next frame is interrupted
+	struct sigaction sa = {.sa_handler = quit};
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	// Only the frame buffer and the resolution of the CPU are used
+	static CPU cpu;
+	static unsigned char frame[STREAM_FRAME_SIZE];
+	static unsigned char payload[STREAM_MAX_MESSAGE];
+	Renderer *r = new_renderer(mode);
+	bool placed = false;
+
+	// Clear the terminal and hide the cursor
+	printf("\033[2J\033[?25l");
+	fflush(stdout);
+
+	unsigned char header[4];
+	while(!quit_requested && read_full(fd, header, sizeof(header))){
+		size_t size = header[2] | header[3] << 8;
+		if(size > sizeof(payload) || !read_full(fd, payload, size)){
+			break;
+		}
+		if(header[0] == 'K'){
+			memset(frame, 0x0, sizeof(frame));
+		} else if(header[0] != 'D'){
+			break;
+		}
+		if(!stream_decode(payload, size, frame)){
+			break;
+		}
+
+		bool hires = header[1] & STREAM_HIRES;
+		if(!placed || hires != cpu.hires){
+			int cols, rows;
+			cpu.hires = hires;
+			render_cells(mode, SCREEN_WIDTH(&cpu), SCREEN_HEIGHT(&cpu), &cols,
+					&rows);
+			renderer_place(r, 1, 1, cols, rows);
+			placed = true;
+		}
+		stream_load(&cpu, frame);
+		renderer_draw(r, &cpu, false);
+	}
+
+	// Cursor back, below the game
+	printf("\033[?25h\033[%d;1H\n", GFX_ROWS + 1);
+	return 0;
+}
@@ -0,0 +1,303 @@
+// Gameplay capture (see capture.h). Like audio, the emulation thread only
+// copies frames into the ring; all the encoding happens on its own thread.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "capture.h"
+
+// Colours: nothing, plane 1, plane 2, both planes
+static const unsigned char palette[4][3] = {
+	{ 0x00, 0x00, 0x00 }, { 0xFF, 0xFF, 0xFF },
+	{ 0xAA, 0xAA, 0xAA }, { 0x55, 0x55, 0x55 }
+};
+
+// GIF data sub-blocks of LZW codes, least significant bit first
+typedef struct {
+	FILE *file;
+	uint32_t bits;
+	int count;
+	unsigned char block[255];
+	int size;
+} BitWriter;
+
+static void put_le16(FILE *f, unsigned int value)
+{
+	fputc(value & 0xFF, f);
+	fputc(value >> 8 & 0xFF, f);
+}
+
+static void flush_block(BitWriter *w)
+{
+	if(w->size > 0){
+		fputc(w->size, w->file);
+		fwrite(w->block, 1, w->size, w->file);
+		w->size = 0;
+	}
+}
+
+static void put_code(BitWriter *w, unsigned int code, int width)
+{
+	w->bits |= code << w->count;
+	w->count += width;
+	while(w->count >= 8){
+		w->block[w->size++] = w->bits & 0xFF;
+		w->bits >>= 8;
+		w->count -= 8;
+		if(w->size == sizeof(w->block)){
+			flush_block(w);
+		}
+	}
+}
+
+// LZW compresses n 2 bits pixels as GIF image data. With 4 symbols, the
+// dictionary is a plain table of children.
+static void lzw(FILE *f, const unsigned char *pixels, size_t n)
+{
+	static uint16_t children[4096][4];
+	const int min_size = 2, clear = 1 << min_size, eoi = clear + 1;
+	BitWriter w = { .file = f };
+	int width = min_size + 1;
+	int last = eoi;
+
+	fputc(min_size, f);
+	memset(children, 0x0, sizeof(children));
+	put_code(&w, clear, width);
+	int code = pixels[0];
+	for(size_t i = 1; i < n; i++){
+		int k = pixels[i];
+		if(children[code][k] != 0){
+			code = children[code][k];
+			continue;
+		}
+		put_code(&w, code, width);
+		children[code][k] = ++last;
+		if(last >= 1 << width){
+			width++;
+		}
+		if(last == 4095){
+			put_code(&w, clear, width);
+			memset(children, 0x0, sizeof(children));
+			width = min_size + 1;
+			last = eoi;
+		}
+		code = k;
+	}
+	put_code(&w, code, width);
+	// The decoder adds an entry for that last code too, which may take
+	// one more bit
+	if(last + 1 >= 1 << width && width < 12){
+		width++;
+	}
+	put_code(&w, clear, width);
+	put_code(&w, eoi, min_size + 1);
+	if(w.count > 0){
+		put_code(&w, 0, 8 - w.count);
+	}
+	flush_block(&w);
+	fputc(0, f);
+}
+
+// Draws a frame at the capture size: every row of the screen once, then
+// copies of it
+static void render(const CaptureFrame *frame,
+		unsigned char image[CAPTURE_HEIGHT][CAPTURE_WIDTH])
+{
+	int shift = frame->hires ? 1 : 2;
+	int scale = 1 << shift;
+	for(int row = 0; row < CAPTURE_HEIGHT >> shift; row++){
+		unsigned char *line = image[row << shift];
+		for(int col = 0; col < CAPTURE_WIDTH >> shift; col++){
+			int bit = 63 - (col & 63);
+			int colour = (frame->gfx[0][row][col >> 6] >> bit & 1) |
+				(frame->gfx[1][row][col >> 6] >> bit & 1) << 1;
+			memset(&line[col << shift], colour, scale);
+		}
+		for(int y = 1; y < scale; y++){
+			memcpy(image[(row << shift) + y], line, CAPTURE_WIDTH);
+		}
+	}
+}
+
+// Writes the pending frame, shown for delay centiseconds. Only the rectangle
+// that differs from the canvas is encoded, the rest stays as it was.
+static void write_frame(Capture *c, unsigned int delay)
+{
+	static unsigned char pixels[CAPTURE_WIDTH * CAPTURE_HEIGHT];
+	render(&c->pending, c->next);
+	int top = CAPTURE_HEIGHT, bottom = 0, left = CAPTURE_WIDTH, right = 0;
+	for(int y = 0; y < CAPTURE_HEIGHT; y++){
+		if(c->written > 0 && memcmp(c->next[y], c->shown[y],
+					CAPTURE_WIDTH) == 0){
+			continue;
+		}
+		int x0 = 0, x1 = CAPTURE_WIDTH - 1;
+		if(c->written > 0){
+			while(c->next[y][x0] == c->shown[y][x0]){
+				x0++;
+			}
+			while(c->next[y][x1] == c->shown[y][x1]){
+				x1--;
+			}
+		}
+		top = y < top ? y : top;
+		bottom = y;
+		left = x0 < left ? x0 : left;
+		right = x1 > right ? x1 : right;
+	}
+	if(top > bottom){
+		// Same picture as before, a pixel keeps the delay
+		top = bottom = left = right = 0;
+	}
+
+	// Graphic control extension: no disposal, the delay
+	fputc(0x21, c->file);
+	fputc(0xF9, c->file);
+	fputc(4, c->file);
+	fputc(0x04, c->file);
+	put_le16(c->file, delay);
+	fputc(0, c->file);
+	fputc(0, c->file);
+
+	// Image descriptor, no local colour table
+	int width = right - left + 1, height = bottom - top + 1;
+	fputc(0x2C, c->file);
+	put_le16(c->file, left);
+	put_le16(c->file, top);
+	put_le16(c->file, width);
+	put_le16(c->file, height);
+	fputc(0, c->file);
+
+	size_t n = 0;
+	for(int y = top; y <= bottom; y++){
+		memcpy(&pixels[n], &c->next[y][left], width);
+		n += width;
+	}
+	lzw(c->file, pixels, n);
+	memcpy(c->shown, c->next, sizeof(c->shown));
+	c->written++;
+}
+
+// Centiseconds from the start of the game to a frame, rounded
+static unsigned long centiseconds(unsigned long frame)
+{
+	return (frame * 100 + 30) / 60;
+}
+
+// Takes a frame from the ring: drops it if it looks like the pending one,
+// otherwise the pending one is written now that its delay is known
+static void encode(Capture *c, const CaptureFrame *frame)
+{
+	if(!c->has_pending){
+		c->pending = *frame;
+		c->has_pending = true;
+		c->shown_cs = centiseconds(frame->frame);
+		return;
+	}
+	if(frame->hires == c->pending.hires &&
+			memcmp(frame->gfx, c->pending.gfx, sizeof(frame->gfx)) == 0){
+		return;
+	}
+	unsigned long cs = centiseconds(frame->frame);
+	if(cs - c->shown_cs >= CAPTURE_MIN_DELAY){
+		write_frame(c, cs - c->shown_cs);
+		c->shown_cs = cs;
+	}
+	// Too short to be shown otherwise: this frame takes its place
+	c->pending = *frame;
+}
+
+static void *capture_thread(void *arg)
+{
+	Capture *c = arg;
+	while(1){
+		size_t tail = atomic_load_explicit(&c->tail, memory_order_relaxed);
+		size_t head = atomic_load_explicit(&c->head, memory_order_acquire);
+		if(head == tail){
+			if(!atomic_load(&c->running)){
+				break;
+			}
+			usleep(1000);
+			continue;
+		}
+		encode(c, &c->slots[tail % CAPTURE_SLOTS]);
+		atomic_store_explicit(&c->tail, tail + 1, memory_order_release);
+	}
+
+	// The last frame lasts until the end of the capture
+	if(c->has_pending){
+		unsigned long cs = centiseconds(c->end);
+		write_frame(c, cs > c->shown_cs + CAPTURE_MIN_DELAY ?
+				cs - c->shown_cs : CAPTURE_MIN_DELAY);
+	}
+	return NULL;
+}
+
+// Creates the GIF. With wait, frames are never dropped: the emulation
+// waits for the encoder instead (headless runs). Returns NULL on failure.
+Capture *capture_open(const char *path, bool wait)
+{
+	FILE *f = fopen(path, "wb");
+	if(f == NULL){
+		return NULL;
+	}
+	Capture *c = calloc(1, sizeof(Capture));
+	assert(c != NULL);
+	c->file = f;
+	c->wait = wait;
+
+	// Header, screen descriptor with a 4 colours global table, and looping
+	fwrite("GIF89a", 1, 6, f);
+	put_le16(f, CAPTURE_WIDTH);
+	put_le16(f, CAPTURE_HEIGHT);
+	fputc(0x91, f);
+	fputc(0, f);
+	fputc(0, f);
+	fwrite(palette, 1, sizeof(palette), f);
+	fwrite("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 1, 19, f);
+
+	atomic_store(&c->running, true);
+	if(pthread_create(&c->thread, NULL, capture_thread, c) != 0){
+		fclose(f);
+		free(c);
+		return NULL;
+	}
+	return c;
+}
+
+// Encodes what is left and finishes the GIF. frame is the emulated frame
+// the capture ends at.
+void capture_close(Capture *c, unsigned long frame)
+{
+	if(c == NULL){
+		return;
+	}
+	c->end = frame;
+	atomic_store(&c->running, false);
+	pthread_join(c->thread, NULL);
+	fputc(0x3B, c->file);
+	fclose(c->file);
+	free(c);
+}
+
+// Copies a presented frame into the ring
+void capture_frame(Capture *c, const CPU *cpu, unsigned long frame)
+{
+	size_t head = atomic_load_explicit(&c->head, memory_order_relaxed);
+	while(head - atomic_load_explicit(&c->tail, memory_order_acquire) ==
+			CAPTURE_SLOTS){
+		if(!c->wait){
+			c->dropped++;
+			return;
+		}
+		sched_yield();
+	}
+	CaptureFrame *slot = &c->slots[head % CAPTURE_SLOTS];
+	memcpy(slot->gfx, cpu->gfx, sizeof(slot->gfx));
+	slot->hires = cpu->hires;
+	slot->frame = frame;
+	atomic_store_explicit(&c->head, head + 1, memory_order_release);
+}
@@ -0,0 +1,55 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "cpu.h"
+
+// Gameplay capture to an animated GIF (-o). Presented frames are copied into
+// a ring allocated once (single producer, single consumer), an encoder
+// thread turns them into GIF frames: 4 colours (one per plane combination),
+// LZW compressed, only the area that changed.
+//
+// Delays follow the emulated 60 Hz frames, in centiseconds rounded so they
+// never drift. Identical frames are merged, and so are frames that would
+// last less than 2 cs, which most viewers would slow down to 10 cs.
+#define CAPTURE_SLOTS 64
+#define CAPTURE_WIDTH 256				// 4x4 pixels per low resolution
+#define CAPTURE_HEIGHT 128				// pixel, 2x2 per high resolution one
+#define CAPTURE_MIN_DELAY 2
+
+typedef struct {
+	uint64_t gfx[GFX_PLANES][GFX_ROWS][2];
+	bool hires;
+	unsigned long frame;			// emulated frame it was presented at
+} CaptureFrame;
+
+typedef struct {
+	CaptureFrame slots[CAPTURE_SLOTS];
+	atomic_size_t head;				// frames copied (emulation thread)
+	atomic_size_t tail;				// frames encoded (encoder thread)
+	atomic_bool running;
+	pthread_t thread;
+	bool wait;						// wait for room instead of dropping
+	unsigned long end;				// frame the capture stopped at
+	FILE *file;
+	// Encoder: the frame on the GIF canvas, and the one waiting for its
+	// delay (it's known once the next different frame comes)
+	unsigned char shown[CAPTURE_HEIGHT][CAPTURE_WIDTH];
+	unsigned char next[CAPTURE_HEIGHT][CAPTURE_WIDTH];
+	CaptureFrame pending;
+	bool has_pending;
+	unsigned long shown_cs;			// centiseconds written so far
+	unsigned long written;			// GIF frames
+	unsigned long dropped;			// frames the ring had no room for
+} Capture;
+
+Capture *capture_open(const char *path, bool wait);
+void capture_close(Capture *c, unsigned long frame);
+void capture_frame(Capture *c, const CPU *cpu, unsigned long frame);
+
+#endif
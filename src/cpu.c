@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "cpu.h"
+
+// Creates a new CPU structure
+CPU *new_cpu()
+{
+	CPU *cpu = malloc(sizeof(CPU));
+	assert(cpu != NULL);
+	reset_cpu(cpu);
+	return cpu;
+}
+
+// Zeroes the whole machine and reloads the fonts
+void reset_cpu(CPU *cpu)
+{
+	memset(cpu, 0x0, sizeof(CPU));
+	cpu->sp = -1;
+	cpu->pc = 0x200;
+	cpu->planes = 1;
+	cpu->pitch = 64;
+	cpu->rng = CPU_SEED;
+	initFonts(cpu);
+}
+
+bool push_stack(unsigned short value, CPU *cpu)
+{
+	if(cpu->sp >= 15){
+		return false;
+	}
+	cpu->sp++;
+	cpu->stack[cpu->sp] = value;
+	return true;
+}
+
+unsigned short pop_stack(CPU *cpu)
+{
+	if(cpu->sp == -1){
+		return 0xffff;
+	}
+	unsigned short ret = cpu->stack[cpu->sp];
+	cpu->sp--;
+	return ret;
+}
+
+// Clears the selected planes
+void gfx_clear(CPU *cpu)
+{
+	for(int p = 0; p < GFX_PLANES; p++){
+		if(cpu->planes & (1 << p)){
+			memset(cpu->gfx[p], 0x0, sizeof(cpu->gfx[p]));
+		}
+	}
+	cpu->draw = true;
+}
+
+// Scrolls the selected planes by dx pixels to the right (left if negative)
+// and dy pixels down (up if negative). Pixels scrolled in are cleared.
+void gfx_scroll(CPU *cpu, int dx, int dy)
+{
+	int width = SCREEN_WIDTH(cpu);
+	int height = SCREEN_HEIGHT(cpu);
+	int n = dy < 0 ? -dy : dy;
+	if(n > height){
+		n = height;
+	}
+
+	for(int p = 0; p < GFX_PLANES; p++){
+		if(!(cpu->planes & (1 << p))){
+			continue;
+		}
+		uint64_t (*rows)[2] = cpu->gfx[p];
+
+		if(dy > 0){
+			memmove(&rows[n], &rows[0], (height - n) * sizeof(rows[0]));
+			memset(&rows[0], 0x0, n * sizeof(rows[0]));
+		} else if(dy < 0){
+			memmove(&rows[0], &rows[n], (height - n) * sizeof(rows[0]));
+			memset(&rows[height - n], 0x0, n * sizeof(rows[0]));
+		}
+
+		if(dx == 0){
+			continue;
+		}
+		for(int y = 0; y < height; y++){
+			if(width == 64){
+				rows[y][0] = dx > 0 ? rows[y][0] >> dx : rows[y][0] << -dx;
+			} else if(dx > 0){
+				rows[y][1] = rows[y][1] >> dx | rows[y][0] << (64 - dx);
+				rows[y][0] >>= dx;
+			} else {
+				rows[y][0] = rows[y][0] << -dx | rows[y][1] >> (64 + dx);
+				rows[y][1] <<= -dx;
+			}
+		}
+	}
+	cpu->draw = true;
+}
+
+// Writes the mnemonic of an opcode (debug window only)
+void disasm(unsigned short opcode, char *mnemonic, size_t n)
+{
+	unsigned int X = opcode >> 8 & 0xF;
+	unsigned int Y = opcode >> 4 & 0xF;
+	unsigned short NN = opcode & 0x00FF;
+	unsigned short NNN = opcode & 0x0FFF;
+
+	snprintf(mnemonic, n, "UNK OPCODE");
+	switch(opcode & 0xF000){
+		case 0x0000:
+			if(opcode == 0x00E0){
+				snprintf(mnemonic, n, "CLR");
+			} else if(opcode == 0x00EE){
+				snprintf(mnemonic, n, "RET");
+			} else if((opcode & 0xFFF0) == 0x00C0){
+				snprintf(mnemonic, n, "SCD %d", opcode & 0xF);
+			} else if((opcode & 0xFFF0) == 0x00D0){
+				snprintf(mnemonic, n, "SCU %d", opcode & 0xF);
+			} else if(opcode == 0x00FB){
+				snprintf(mnemonic, n, "SCR");
+			} else if(opcode == 0x00FC){
+				snprintf(mnemonic, n, "SCL");
+			} else if(opcode == 0x00FD){
+				snprintf(mnemonic, n, "EXIT");
+			} else if(opcode == 0x00FE){
+				snprintf(mnemonic, n, "LOW");
+			} else if(opcode == 0x00FF){
+				snprintf(mnemonic, n, "HIGH");
+			} else {
+				snprintf(mnemonic, n, "SYS 0x%03x", NNN);
+			}
+			break;
+		case 0x1000: snprintf(mnemonic, n, "JMP 0x%03x", NNN); break;
+		case 0x2000: snprintf(mnemonic, n, "CALL 0x%03x", NNN); break;
+		case 0x3000: snprintf(mnemonic, n, "SEQ V%d, 0x%02x", X, NN); break;
+		case 0x4000: snprintf(mnemonic, n, "SNEQ V%d, 0x%02x", X, NN); break;
+		case 0x5000:
+			switch(opcode & 0x000F){
+				case 0x0: snprintf(mnemonic, n, "SEQ V%d, V%d", X, Y); break;
+				case 0x2: snprintf(mnemonic, n, "SAVE V%d-V%d", X, Y); break;
+				case 0x3: snprintf(mnemonic, n, "LOAD V%d-V%d", X, Y); break;
+			}
+			break;
+		case 0x6000: snprintf(mnemonic, n, "STR 0x%02x, V%d", NN, X); break;
+		case 0x7000: snprintf(mnemonic, n, "ADD V%d, 0x%02x", X, NN); break;
+		case 0x8000:
+			switch(opcode & 0x000F){
+				case 0x0: snprintf(mnemonic, n, "STR V%x, V%x", Y, X); break;
+				case 0x1: snprintf(mnemonic, n, "OR V%d, V%d", X, Y); break;
+				case 0x2: snprintf(mnemonic, n, "AND V%d, V%d", X, Y); break;
+				case 0x3: snprintf(mnemonic, n, "XOR V%d, V%d", X, Y); break;
+				case 0x4: snprintf(mnemonic, n, "ADD V%d, V%d", X, Y); break;
+				case 0x5: snprintf(mnemonic, n, "SUB V%d, V%d", X, Y); break;
+				case 0x6: snprintf(mnemonic, n, "SHR V%d, 1", X); break;
+				case 0x7: snprintf(mnemonic, n, "SUBI V%d, V%d", X, Y); break;
+				case 0xE: snprintf(mnemonic, n, "SHL V%d, 1", X); break;
+			}
+			break;
+		case 0x9000: snprintf(mnemonic, n, "SNEQ V%d, V%d", X, Y); break;
+		case 0xa000: snprintf(mnemonic, n, "MSTR 0x%03x", NNN); break;
+		case 0xb000: snprintf(mnemonic, n, "JMPA V0, 0x%03x", NNN); break;
+		case 0xc000: snprintf(mnemonic, n, "RAND 0x%02x", NN); break;
+		case 0xd000: snprintf(mnemonic, n, "DRAW"); break;
+		case 0xe000:
+			if(NN == 0x9E){
+				snprintf(mnemonic, n, "SKP V%d", X);
+			} else if(NN == 0xA1){
+				snprintf(mnemonic, n, "SKNP V%d", X);
+			}
+			break;
+		case 0xf000:
+			switch(NN){
+				case 0x00:
+					if(opcode == 0xF000){
+						snprintf(mnemonic, n, "LONG I");
+					}
+					break;
+				case 0x01: snprintf(mnemonic, n, "PLANE %d", X); break;
+				case 0x02: snprintf(mnemonic, n, "AUDIO"); break;
+				case 0x07: snprintf(mnemonic, n, "TIME V%d, delay", X); break;
+				case 0x0A: snprintf(mnemonic, n, "LD V%d, K", X); break;
+				case 0x15: snprintf(mnemonic, n, "TIME delay, V%d", X); break;
+				case 0x18: snprintf(mnemonic, n, "SNDT V%d", X); break;
+				case 0x1e: snprintf(mnemonic, n, "MEMA V%d", X); break;
+				case 0x29: snprintf(mnemonic, n, "CHAR V%d", X); break;
+				case 0x30: snprintf(mnemonic, n, "BCHAR V%d", X); break;
+				case 0x3A: snprintf(mnemonic, n, "PITCH V%d", X); break;
+				case 0x33: snprintf(mnemonic, n, "BCD V%d", X); break;
+				case 0x55: snprintf(mnemonic, n, "REGD V0-V%d", X); break;
+				case 0x65: snprintf(mnemonic, n, "LDR V0-V%d", X); break;
+				case 0x75: snprintf(mnemonic, n, "SRPL V0-V%d", X); break;
+				case 0x85: snprintf(mnemonic, n, "LRPL V0-V%d", X); break;
+			}
+			break;
+	}
+}
+
+void initFonts(CPU *cpu)
+{
+	// Initializes the emulator's default fonts (0-F)
+	// located at addresses 0x0000 to 0x00F5
+	char characters[] = { 0xF0,0x90,0x90,0x90,0xF0,
+						0x20,0x60,0x20,0x20,0x70,
+						0xF0,0x10,0xF0,0x80,0xF0,
+						0xF0,0x10,0xF0,0x10,0xF0,
+						0x90,0x90,0xF0,0x10,0x10,
+						0xF0,0x80,0xF0,0x10,0xF0,
+						0xF0,0x80,0xF0,0x90,0xF0,
+						0xF0,0x10,0x20,0x40,0x40,
+						0xF0,0x90,0xF0,0x90,0xF0,
+						0xF0,0x90,0xF0,0x10,0xF0,
+						0xF0,0x90,0xF0,0x90,0x90,
+						0xE0,0x90,0xE0,0x90,0xE0,
+						0xF0,0x80,0x80,0x80,0xF0,
+						0xE0,0x90,0x90,0x90,0xE0,
+						0xF0,0x80,0xF0,0x80,0xF0,
+						0xF0,0x80,0xF0,0x80,0x80};
+
+	for(int i = 0; i <= 0xF; i++){
+		memcpy(&cpu->memory[FONT_SMALL + (i << 4)], &characters[i*5], 5);
+	};
+
+	// SUPER-CHIP 8x10 fonts (0-F) located at addresses 0x0100 to 0x019F
+	unsigned char big_characters[] = {
+						0xFF,0xFF,0xC3,0xC3,0xC3,0xC3,0xC3,0xC3,0xFF,0xFF,
+						0x18,0x78,0x78,0x18,0x18,0x18,0x18,0x18,0xFF,0xFF,
+						0xFF,0xFF,0x03,0x03,0xFF,0xFF,0xC0,0xC0,0xFF,0xFF,
+						0xFF,0xFF,0x03,0x03,0xFF,0xFF,0x03,0x03,0xFF,0xFF,
+						0xC3,0xC3,0xC3,0xC3,0xFF,0xFF,0x03,0x03,0x03,0x03,
+						0xFF,0xFF,0xC0,0xC0,0xFF,0xFF,0x03,0x03,0xFF,0xFF,
+						0xFF,0xFF,0xC0,0xC0,0xFF,0xFF,0xC3,0xC3,0xFF,0xFF,
+						0xFF,0xFF,0x03,0x03,0x06,0x0C,0x18,0x18,0x18,0x18,
+						0xFF,0xFF,0xC3,0xC3,0xFF,0xFF,0xC3,0xC3,0xFF,0xFF,
+						0xFF,0xFF,0xC3,0xC3,0xFF,0xFF,0x03,0x03,0xFF,0xFF,
+						0x7E,0xFF,0xC3,0xC3,0xC3,0xFF,0xFF,0xC3,0xC3,0xC3,
+						0xFC,0xFC,0xC3,0xC3,0xFC,0xFC,0xC3,0xC3,0xFC,0xFC,
+						0x3C,0xFF,0xC3,0xC0,0xC0,0xC0,0xC0,0xC3,0xFF,0x3C,
+						0xFC,0xFE,0xC3,0xC3,0xC3,0xC3,0xC3,0xC3,0xFE,0xFC,
+						0xFF,0xFF,0xC0,0xC0,0xFF,0xFF,0xC0,0xC0,0xFF,0xFF,
+						0xFF,0xFF,0xC0,0xC0,0xFF,0xFF,0xC0,0xC0,0xC0,0xC0};
+
+	memcpy(&cpu->memory[FONT_BIG], big_characters, sizeof(big_characters));
+}
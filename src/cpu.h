@@ -0,0 +1,90 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "quirks.h"
+
+// Memory size (XO-CHIP), ROMs are loaded at 0x200
+#define MEMORY_SIZE 0x10000
+
+// The frame buffer is stored as bitplanes: every row of a plane is 128 bits
+// wide, split in two words with the leftmost pixel in the most significant
+// bit of gfx[plane][row][0]. Low resolution (64x32) only uses the first word
+// of the first 32 rows, so the screen size never costs more than it shows.
+#define GFX_PLANES 2
+#define GFX_ROWS 64
+
+// Font locations: 4x5 digits and 8x10 digits (SUPER-CHIP)
+#define FONT_SMALL 0x000
+#define FONT_BIG 0x100
+
+// A struct representing the CPU.
+typedef struct {
+	unsigned char memory[MEMORY_SIZE];	// memory
+	unsigned char V[16];			// registers
+	unsigned short stack[16];		// call stack
+	uint64_t gfx[GFX_PLANES][GFX_ROWS][2];	// frame buffer (bitplanes)
+	unsigned char input[16];		// keyboard inputs
+	unsigned short I;				// index registers
+	unsigned short pc;				// program counter
+	unsigned char delay_timer;		// delay timer
+	unsigned char sound_timer;		// sound timer
+	int sp;							// stack pointer
+	bool draw;						// draw flag
+	bool key_is_pressed;			// self explanatory
+	bool hires;						// 128x64 mode (SUPER-CHIP)
+	bool exit;						// 00FD was executed (SUPER-CHIP)
+	unsigned char planes;			// planes selected by Fn01 (XO-CHIP)
+	unsigned char rpl[16];			// user flags of Fx75/Fx85 (SUPER-CHIP)
+	unsigned char pattern[16];		// audio pattern of F002 (XO-CHIP)
+	bool has_pattern;				// F002 was executed, the buzzer is off
+	unsigned char pitch;			// audio pitch of Fx3A (XO-CHIP)
+	uint32_t rng;					// random number state (Cxkk)
+	int cycles;						// left in the frame (VIP timing)
+} CPU;
+
+// Seed of rng after a reset. The state lives in the CPU so that a run only
+// depends on its inputs, and restoring a copy of the CPU replays it exactly.
+#define CPU_SEED 0x2545F491
+
+// Next random number (xorshift32)
+static inline uint32_t cpu_random(CPU *cpu)
+{
+	uint32_t x = cpu->rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return cpu->rng = x;
+}
+
+#define SCREEN_WIDTH(cpu) ((cpu)->hires ? 128 : 64)
+#define SCREEN_HEIGHT(cpu) ((cpu)->hires ? 64 : 32)
+
+// Returns the colour (0-3, one bit per plane) of the pixel at x, y
+static inline int gfx_pixel(const CPU *cpu, int x, int y)
+{
+	int bit = 63 - (x & 63);
+	return (cpu->gfx[0][y][x >> 6] >> bit & 1) |
+		(cpu->gfx[1][y][x >> 6] >> bit & 1) << 1;
+}
+
+// Executes the instruction at pc. Returns false on an unknown opcode, or
+// when the program exits (chip8->exit is set).
+typedef bool (*step_fn)(CPU *chip8);
+
+// One specialized interpreter per quirk profile, indexed by Profile
+extern const step_fn cpu_steps[PROFILE_COUNT];
+
+CPU *new_cpu();
+void reset_cpu(CPU *cpu);
+void initFonts(CPU *cpu);
+bool push_stack(unsigned short value, CPU *cpu);
+unsigned short pop_stack(CPU *cpu);
+void gfx_clear(CPU *cpu);
+void gfx_scroll(CPU *cpu, int dx, int dy);
+void disasm(unsigned short opcode, char *mnemonic, size_t n);
+
+#endif
@@ -0,0 +1,773 @@
+// GDB remote serial protocol (see gdb.h). The debugger is served by the
+// emulation thread between frames. While the program is stopped no frame
+// runs, and the thread waits for the debugger outside the emulator lock.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "gdb.h"
+
+// Register numbers of target.xml
+#define REG_I 16
+#define REG_PC 17
+#define REG_SP 18
+#define REG_DT 19
+#define REG_ST 20
+#define REG_STACK 21
+#define REG_COUNT 37
+
+// What receive() got
+#define GOT_NOTHING 0
+#define GOT_PACKET 1
+#define GOT_INTERRUPT 2
+#define GOT_HANGUP 3
+
+// What a packet asks of the program
+#define STAY 0
+#define RESUME 1
+#define KILL 2
+
+static const char hex[] = "0123456789abcdef";
+
+// Starts listening on a localhost port. Returns NULL (errno set) on failure.
+Gdb *gdb_open(const char *port)
+{
+	int p = atoi(port);
+	if(p <= 0 || p > 0xFFFF){
+		errno = EINVAL;
+		return NULL;
+	}
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if(fd < 0){
+		return NULL;
+	}
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	struct sockaddr_in in;
+	memset(&in, 0x0, sizeof(in));
+	in.sin_family = AF_INET;
+	in.sin_port = htons(p);
+	in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if(bind(fd, (struct sockaddr *)&in, sizeof(in)) < 0 || listen(fd, 1) < 0){
+		close(fd);
+		return NULL;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	Gdb *g = calloc(1, sizeof(Gdb));
+	assert(g != NULL);
+	g->fd = fd;
+	g->client = -1;
+	g->skip_pc = -1;
+	return g;
+}
+
+// Forgets the debugger and everything it set, the program runs on
+static void hang_up(Gdb *g)
+{
+	close(g->client);
+	g->client = -1;
+	g->stopped = false;
+	g->report = false;
+	g->stepping = false;
+	g->skip_pc = -1;
+	memset(g->breakpoints, 0x0, sizeof(g->breakpoints));
+	g->breakpoint_count = 0;
+	g->watchpoint_count = 0;
+	g->in_pos = g->in_len = 0;
+	g->state = 0;
+}
+
+void gdb_close(Gdb *g)
+{
+	if(g == NULL){
+		return;
+	}
+	if(g->client >= 0){
+		hang_up(g);
+	}
+	close(g->fd);
+	free(g);
+}
+
+static void send_all(Gdb *g, const char *buf, size_t n)
+{
+	while(n > 0){
+		ssize_t w = send(g->client, buf, n, MSG_NOSIGNAL);
+		if(w <= 0){
+			// Noticed by the next receive()
+			return;
+		}
+		buf += w;
+		n -= w;
+	}
+}
+
+// Sends $data#checksum
+static void send_packet(Gdb *g, const char *data)
+{
+	static char buf[GDB_PACKET_SIZE * 2 + 4];
+	unsigned char sum = 0;
+	size_t n = 0;
+	buf[n++] = '$';
+	for(; *data != '\0'; data++){
+		buf[n++] = *data;
+		sum += *data;
+	}
+	buf[n++] = '#';
+	buf[n++] = hex[sum >> 4];
+	buf[n++] = hex[sum & 0xF];
+	send_all(g, buf, n);
+}
+
+static int hex_value(char c)
+{
+	if(c >= '0' && c <= '9'){
+		return c - '0';
+	}
+	if(c >= 'a' && c <= 'f'){
+		return c - 'a' + 10;
+	}
+	if(c >= 'A' && c <= 'F'){
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+// Reads a hex number and moves *p past it
+static unsigned long parse_hex(const char **p)
+{
+	unsigned long value = 0;
+	int d;
+	while((d = hex_value(**p)) >= 0){
+		value = value << 4 | d;
+		(*p)++;
+	}
+	return value;
+}
+
+// Takes in what the debugger sent, without waiting. A whole packet ends up
+// in g->packet, and is acknowledged.
+static int receive(Gdb *g)
+{
+	while(1){
+		if(g->in_pos == g->in_len){
+			ssize_t n = recv(g->client, g->in, sizeof(g->in), MSG_DONTWAIT);
+			if(n == 0){
+				return GOT_HANGUP;
+			}
+			if(n < 0){
+				if(errno == EINTR){
+					continue;
+				}
+				return errno == EAGAIN || errno == EWOULDBLOCK ? GOT_NOTHING :
+					GOT_HANGUP;
+			}
+			g->in_pos = 0;
+			g->in_len = n;
+		}
+		char c = g->in[g->in_pos++];
+		switch(g->state){
+			case 0:
+				// Acknowledgements don't matter over TCP
+				if(c == '$'){
+					g->state = 1;
+					g->size = 0;
+					g->checksum = 0;
+				} else if(c == 0x03){
+					return GOT_INTERRUPT;
+				}
+				break;
+			case 1:
+				if(c == '#'){
+					g->state = 2;
+				} else {
+					g->checksum -= c;
+					if(g->size < sizeof(g->packet) - 1){
+						g->packet[g->size++] = c;
+					}
+				}
+				break;
+			case 2:
+				g->checksum += hex_value(c) << 4;
+				g->state = 3;
+				break;
+			case 3:
+				g->checksum += hex_value(c);
+				g->state = 0;
+				g->packet[g->size] = '\0';
+				if(g->checksum != 0){
+					send_all(g, "-", 1);
+					break;
+				}
+				send_all(g, "+", 1);
+				return GOT_PACKET;
+		}
+	}
+}
+
+static void stop(Gdb *g, int signal, const char *reason)
+{
+	g->stopped = true;
+	g->report = true;
+	g->stepping = false;
+	snprintf(g->stop_reply, sizeof(g->stop_reply), "T%02x%s", signal, reason);
+}
+
+static int reg_size(int r)
+{
+	return r == REG_I || r == REG_PC || r >= REG_STACK ? 2 : 1;
+}
+
+static unsigned int reg_get(const CPU *cpu, int r)
+{
+	if(r < 16){
+		return cpu->V[r];
+	}
+	switch(r){
+		case REG_I:
+			return cpu->I;
+		case REG_PC:
+			return cpu->pc;
+		case REG_SP:
+			return cpu->sp & 0xFF;
+		case REG_DT:
+			return cpu->delay_timer;
+		case REG_ST:
+			return cpu->sound_timer;
+	}
+	return cpu->stack[r - REG_STACK];
+}
+
+static void reg_set(CPU *cpu, int r, unsigned int value)
+{
+	if(r < 16){
+		cpu->V[r] = value;
+		return;
+	}
+	switch(r){
+		case REG_I:
+			cpu->I = value;
+			return;
+		case REG_PC:
+			cpu->pc = value;
+			return;
+		case REG_SP:
+			cpu->sp = (signed char)value;
+			if(cpu->sp < -1 || cpu->sp > 15){
+				cpu->sp = -1;
+			}
+			return;
+		case REG_DT:
+			cpu->delay_timer = value;
+			return;
+		case REG_ST:
+			cpu->sound_timer = value;
+			return;
+	}
+	cpu->stack[r - REG_STACK] = value;
+}
+
+// Appends a register in target byte order (little endian)
+static char *put_reg(char *p, const CPU *cpu, int r)
+{
+	unsigned int value = reg_get(cpu, r);
+	for(int b = 0; b < reg_size(r); b++){
+		*p++ = hex[value >> (b * 8 + 4) & 0xF];
+		*p++ = hex[value >> (b * 8) & 0xF];
+	}
+	return p;
+}
+
+// Reads a register written by put_reg. Returns false if it's cut short.
+static bool parse_reg(const char **p, CPU *cpu, int r)
+{
+	unsigned int value = 0;
+	for(int b = 0; b < reg_size(r); b++){
+		int hi = hex_value((*p)[0]);
+		int lo = hi >= 0 ? hex_value((*p)[1]) : -1;
+		if(lo < 0){
+			return false;
+		}
+		value |= (hi << 4 | lo) << (b * 8);
+		*p += 2;
+	}
+	reg_set(cpu, r, value);
+	return true;
+}
+
+static const char *target_xml()
+{
+	static char xml[4096];
+	if(xml[0] != '\0'){
+		return xml;
+	}
+	int n = snprintf(xml, sizeof(xml), "<?xml version=\"1.0\"?>"
+			"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+			"<target version=\"1.0\"><feature name=\"org.yac8e.chip8\">");
+	for(int r = 0; r < 16; r++){
+		n += snprintf(xml + n, sizeof(xml) - n,
+				"<reg name=\"v%x\" bitsize=\"8\" type=\"uint8\"/>", r);
+	}
+	n += snprintf(xml + n, sizeof(xml) - n,
+			"<reg name=\"i\" bitsize=\"16\" type=\"data_ptr\"/>"
+			"<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>"
+			"<reg name=\"sp\" bitsize=\"8\" type=\"int8\"/>"
+			"<reg name=\"dt\" bitsize=\"8\" type=\"uint8\"/>"
+			"<reg name=\"st\" bitsize=\"8\" type=\"uint8\"/>");
+	for(int r = 0; r < 16; r++){
+		n += snprintf(xml + n, sizeof(xml) - n,
+				"<reg name=\"stack%d\" bitsize=\"16\" type=\"uint16\"/>", r);
+	}
+	snprintf(xml + n, sizeof(xml) - n, "</feature></target>");
+	return xml;
+}
+
+// Z and z packets: type,addr,kind
+static const char *set_point(Gdb *g, const char *args, bool insert)
+{
+	int type = parse_hex(&args);
+	if(*args++ != ','){
+		return "E01";
+	}
+	unsigned long addr = parse_hex(&args);
+	unsigned long len = *args == ',' ? (args++, parse_hex(&args)) : 1;
+	if(addr >= MEMORY_SIZE){
+		return "E01";
+	}
+
+	if(type == 0 || type == 1){
+		// Software and hardware breakpoints are the same thing here
+		unsigned char bit = 1 << (addr & 7);
+		bool set = g->breakpoints[addr >> 3] & bit;
+		if(insert && !set){
+			g->breakpoints[addr >> 3] |= bit;
+			g->breakpoint_count++;
+		} else if(!insert && set){
+			g->breakpoints[addr >> 3] &= ~bit;
+			g->breakpoint_count--;
+		}
+		return "OK";
+	}
+	if(type < 2 || type > 4){
+		return "";
+	}
+	if(insert){
+		if(g->watchpoint_count == GDB_MAX_WATCHPOINTS){
+			return "E02";
+		}
+		Watchpoint *w = &g->watchpoints[g->watchpoint_count++];
+		w->addr = addr;
+		w->len = len > 0 ? len : 1;
+		w->type = type;
+		return "OK";
+	}
+	for(int i = 0; i < g->watchpoint_count; i++){
+		Watchpoint *w = &g->watchpoints[i];
+		if(w->addr == addr && w->type == type){
+			*w = g->watchpoints[--g->watchpoint_count];
+			break;
+		}
+	}
+	return "OK";
+}
+
+// qXfer:features:read:target.xml:offset,length
+static void send_xml(Gdb *g, const char *args)
+{
+	static char reply[GDB_PACKET_SIZE];
+	const char *xml = target_xml();
+	unsigned long offset = parse_hex(&args);
+	unsigned long length = *args == ',' ? (args++, parse_hex(&args)) : 0;
+	size_t size = strlen(xml);
+	if(offset > size){
+		send_packet(g, "E01");
+		return;
+	}
+	if(length > sizeof(reply) - 2){
+		length = sizeof(reply) - 2;
+	}
+	// Nothing in the description needs escaping
+	size_t n = size - offset < length ? size - offset : length;
+	reply[0] = offset + n < size ? 'm' : 'l';
+	memcpy(reply + 1, xml + offset, n);
+	reply[n + 1] = '\0';
+	send_packet(g, reply);
+}
+
+static void send_memory(Gdb *g, const CPU *cpu, const char *args)
+{
+	static char reply[GDB_PACKET_SIZE];
+	unsigned long addr = parse_hex(&args);
+	unsigned long len = *args == ',' ? (args++, parse_hex(&args)) : 0;
+	if(addr >= MEMORY_SIZE){
+		send_packet(g, "E01");
+		return;
+	}
+	if(len > (sizeof(reply) - 1) / 2){
+		len = (sizeof(reply) - 1) / 2;
+	}
+	if(len > MEMORY_SIZE - addr){
+		len = MEMORY_SIZE - addr;
+	}
+	char *p = reply;
+	for(unsigned long i = 0; i < len; i++){
+		unsigned char b = cpu->memory[addr + i];
+		*p++ = hex[b >> 4];
+		*p++ = hex[b & 0xF];
+	}
+	*p = '\0';
+	send_packet(g, reply);
+}
+
+// qRcmd,command: `monitor regs` prints the registers in the console, for
+// a GDB that didn't take target.xml
+static void send_monitor(Gdb *g, const CPU *cpu, const char *args)
+{
+	char command[64];
+	size_t n = 0;
+	while(args[0] != '\0' && args[1] != '\0' && n < sizeof(command) - 1){
+		command[n++] = hex_value(args[0]) << 4 | hex_value(args[1]);
+		args += 2;
+	}
+	command[n] = '\0';
+	if(strcmp(command, "regs") != 0){
+		send_packet(g, "");
+		return;
+	}
+
+	char text[512];
+	int len = 0;
+	for(int r = 0; r < 16; r++){
+		len += snprintf(text + len, sizeof(text) - len, "v%x %02x%s", r,
+				cpu->V[r], r == 7 || r == 15 ? "\n" : "  ");
+	}
+	len += snprintf(text + len, sizeof(text) - len,
+			"i %04x  pc %04x  sp %d  dt %02x  st %02x\nstack",
+			cpu->I, cpu->pc, cpu->sp, cpu->delay_timer, cpu->sound_timer);
+	for(int r = 0; r <= cpu->sp && r < 16; r++){
+		len += snprintf(text + len, sizeof(text) - len, " %04x",
+				cpu->stack[r]);
+	}
+	len += snprintf(text + len, sizeof(text) - len, "\n");
+
+	// Console output goes in an O packet, hex encoded
+	static char reply[2 * sizeof(text) + 2];
+	reply[0] = 'O';
+	for(int i = 0; i < len; i++){
+		reply[1 + 2 * i] = hex[(unsigned char)text[i] >> 4];
+		reply[2 + 2 * i] = hex[text[i] & 0xF];
+	}
+	reply[1 + 2 * len] = '\0';
+	send_packet(g, reply);
+	send_packet(g, "OK");
+}
+
+// M addr,len:bytes
+static const char *write_memory(Gdb *g, CPU *cpu, const char *args)
+{
+	unsigned long addr = parse_hex(&args);
+	unsigned long len = *args == ',' ? (args++, parse_hex(&args)) : 0;
+	if(*args++ != ':' || addr + len > MEMORY_SIZE || strlen(args) < len * 2){
+		return "E01";
+	}
+	for(unsigned long i = 0; i < len; i++){
+		int hi = hex_value(args[i * 2]), lo = hex_value(args[i * 2 + 1]);
+		if(hi < 0 || lo < 0){
+			return "E01";
+		}
+		cpu->memory[addr + i] = hi << 4 | lo;
+	}
+	g->patched = true;
+	return "OK";
+}
+
+// Answers a packet, or resumes the program
+static int handle(Gdb *g, CPU *cpu)
+{
+	static char reply[GDB_PACKET_SIZE];
+	const char *args = g->packet + 1;
+	switch(g->packet[0]){
+		case '?':
+			send_packet(g, g->stop_reply);
+			return STAY;
+		case 'g':
+			{
+			char *p = reply;
+			for(int r = 0; r < REG_COUNT; r++){
+				p = put_reg(p, cpu, r);
+			}
+			*p = '\0';
+			send_packet(g, reply);
+			return STAY;
+			}
+		case 'G':
+			for(int r = 0; r < REG_COUNT; r++){
+				if(!parse_reg(&args, cpu, r)){
+					send_packet(g, "E01");
+					return STAY;
+				}
+			}
+			send_packet(g, "OK");
+			return STAY;
+		case 'p':
+			{
+			int r = parse_hex(&args);
+			if(r >= REG_COUNT){
+				send_packet(g, "E01");
+				return STAY;
+			}
+			*put_reg(reply, cpu, r) = '\0';
+			send_packet(g, reply);
+			return STAY;
+			}
+		case 'P':
+			{
+			int r = parse_hex(&args);
+			if(r >= REG_COUNT || *args++ != '=' || !parse_reg(&args, cpu, r)){
+				send_packet(g, "E01");
+				return STAY;
+			}
+			send_packet(g, "OK");
+			return STAY;
+			}
+		case 'm':
+			send_memory(g, cpu, args);
+			return STAY;
+		case 'M':
+			send_packet(g, write_memory(g, cpu, args));
+			return STAY;
+		case 'c':
+		case 's':
+			if(*args != '\0'){
+				cpu->pc = parse_hex(&args);
+			}
+			g->stepping = g->packet[0] == 's';
+			// Don't stop right away on a breakpoint at pc
+			g->skip_pc = cpu->pc;
+			return RESUME;
+		case 'Z':
+		case 'z':
+			send_packet(g, set_point(g, args, g->packet[0] == 'Z'));
+			return STAY;
+		case 'D':
+			send_packet(g, "OK");
+			hang_up(g);
+			return RESUME;
+		case 'k':
+			return KILL;
+		case 'H':
+		case 'T':
+			send_packet(g, "OK");
+			return STAY;
+		case 'q':
+			if(strncmp(args, "Supported", 9) == 0){
+				snprintf(reply, sizeof(reply),
+						"PacketSize=%x;qXfer:features:read+", GDB_PACKET_SIZE);
+				send_packet(g, reply);
+			} else if(strncmp(args, "Xfer:features:read:target.xml:", 30) == 0){
+				send_xml(g, args + 30);
+			} else if(strcmp(args, "Attached") == 0){
+				send_packet(g, "1");
+			} else if(strcmp(args, "C") == 0){
+				send_packet(g, "QC1");
+			} else if(strcmp(args, "fThreadInfo") == 0){
+				send_packet(g, "m1");
+			} else if(strcmp(args, "sThreadInfo") == 0){
+				send_packet(g, "l");
+			} else if(strncmp(args, "Rcmd,", 5) == 0){
+				send_monitor(g, cpu, args + 5);
+			} else if(strncmp(args, "Symbol", 6) == 0){
+				send_packet(g, "OK");
+			} else {
+				send_packet(g, "");
+			}
+			return STAY;
+	}
+	// Not supported
+	send_packet(g, "");
+	return STAY;
+}
+
+// Waits until the debugger sends something, for GDB_POLL_NS at most. Called
+// without the emulator lock while the program is stopped, so that the menu
+// and F1 keep working.
+void gdb_wait(Gdb *g)
+{
+	if(g->client < 0 || g->in_pos < g->in_len){
+		return;
+	}
+	struct pollfd p = {.fd = g->client, .events = POLLIN};
+	poll(&p, 1, GDB_POLL_NS / 1000000);
+}
+
+// Talks to the debugger between frames: takes a new connection, and ^C or
+// packets. Returns false when the debugger kills the program; g->stopped
+// tells whether the program may run a frame.
+bool gdb_serve(Gdb *g, CPU *cpu)
+{
+	if(!g->stopped){
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if((now.tv_sec - g->last.tv_sec) * 1000000000L +
+				(now.tv_nsec - g->last.tv_nsec) < GDB_POLL_NS){
+			return true;
+		}
+		g->last = now;
+	}
+
+	if(g->client < 0){
+		int fd = accept(g->fd, NULL, NULL);
+		if(fd < 0){
+			return true;
+		}
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		g->client = fd;
+		// The debugger expects the program stopped once attached, and asks
+		// why with '?'
+		stop(g, 5, "");
+		g->report = false;
+	}
+
+	if(g->report){
+		send_packet(g, g->stop_reply);
+		g->report = false;
+	}
+	while(g->client >= 0){
+		switch(receive(g)){
+			case GOT_NOTHING:
+				return true;
+			case GOT_HANGUP:
+				hang_up(g);
+				return true;
+			case GOT_INTERRUPT:
+				if(!g->stopped){
+					stop(g, 2, "");
+					send_packet(g, g->stop_reply);
+					g->report = false;
+				}
+				break;
+			case GOT_PACKET:
+				switch(handle(g, cpu)){
+					case RESUME:
+						g->stopped = false;
+						return true;
+					case KILL:
+						hang_up(g);
+						return false;
+				}
+				break;
+		}
+	}
+	return true;
+}
+
+// Memory the instruction at pc reads or writes, besides fetching itself.
+// Returns false if it doesn't touch memory.
+static bool data_access(const CPU *cpu, unsigned int *addr, unsigned int *len,
+		bool *write)
+{
+	unsigned short opcode = cpu->memory[cpu->pc] << 8 |
+		cpu->memory[(cpu->pc + 1) & 0xFFFF];
+	int x = opcode >> 8 & 0xF;
+	int y = opcode >> 4 & 0xF;
+	*addr = cpu->I;
+	*len = 0;
+	*write = false;
+	switch(opcode & 0xF000){
+		case 0x5000:
+			// Save and load vx-vy (XO-CHIP)
+			if((opcode & 0xF) == 2 || (opcode & 0xF) == 3){
+				*len = (x > y ? x - y : y - x) + 1;
+				*write = (opcode & 0xF) == 2;
+			}
+			break;
+		case 0xD000:
+			{
+			// One sprite per selected plane, 16x16 for n = 0
+			int n = opcode & 0xF;
+			int planes = (cpu->planes & 1) + (cpu->planes >> 1 & 1);
+			*len = (n != 0 ? n : 32) * planes;
+			break;
+			}
+		case 0xF000:
+			switch(opcode & 0xFF){
+				case 0x02:
+					if(x == 0){
+						*len = 16;
+					}
+					break;
+				case 0x33:
+					*len = 3;
+					*write = true;
+					break;
+				case 0x55:
+					*len = x + 1;
+					*write = true;
+					break;
+				case 0x65:
+					*len = x + 1;
+					break;
+			}
+			break;
+	}
+	return *len > 0;
+}
+
+// Called before every instruction while armed. Stops on a breakpoint at pc,
+// and returns true, the instruction is not run. Otherwise takes note of the
+// watchpoints it hits.
+bool gdb_before(Gdb *g, const CPU *cpu)
+{
+	bool skip = g->skip_pc == cpu->pc;
+	g->skip_pc = -1;
+	if(!skip && g->breakpoints[cpu->pc >> 3] >> (cpu->pc & 7) & 1){
+		stop(g, 5, "");
+		return true;
+	}
+
+	g->hit[0] = '\0';
+	unsigned int addr, len;
+	bool write;
+	if(g->watchpoint_count == 0 || !data_access(cpu, &addr, &len, &write)){
+		return false;
+	}
+	for(int i = 0; i < g->watchpoint_count; i++){
+		Watchpoint *w = &g->watchpoints[i];
+		if(addr >= w->addr + w->len || w->addr >= addr + len){
+			continue;
+		}
+		if(w->type == 4 || (w->type == 2) == write){
+			static const char *names[] = { "watch", "rwatch", "awatch" };
+			snprintf(g->hit, sizeof(g->hit), "%s:%x;", names[w->type - 2],
+					w->addr);
+			break;
+		}
+	}
+	return false;
+}
+
+// Called after every instruction while armed. Stops on a watchpoint or at
+// the end of a single step, and returns true.
+bool gdb_after(Gdb *g, const CPU *cpu)
+{
+	if(g->hit[0] != '\0'){
+		stop(g, 5, g->hit);
+		return true;
+	}
+	if(g->stepping){
+		stop(g, 5, "");
+		return true;
+	}
+	return false;
+}
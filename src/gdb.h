@@ -0,0 +1,69 @@
+#ifndef GDB_H
+#define GDB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "cpu.h"
+
+// GDB remote serial protocol server on a localhost TCP port (-g), for one
+// debugger at a time: `target remote :port`. Registers are described in
+// target.xml: v0-vf, i, pc, sp (-1 when the stack is empty), dt, st and
+// stack0-stack15, little endian. Memory is the whole address space. GDB has
+// no CHIP-8 architecture and falls back to its own registers, so `monitor
+// regs` prints them as text too.
+//
+// The program only runs through the checking loop of gdb_before/gdb_after
+// while gdb_armed(): breakpoints or watchpoints are set, or a single step is
+// pending. Otherwise the usual loops run as if there was no debugger.
+#define GDB_PACKET_SIZE 4096
+#define GDB_MAX_WATCHPOINTS 16
+// The socket is only looked at this often while the program runs (turbo
+// runs frames much faster than that)
+#define GDB_POLL_NS 10000000L
+
+typedef struct {
+	unsigned int addr, len;
+	int type;						// 2 write, 3 read, 4 access (Z packets)
+} Watchpoint;
+
+typedef struct {
+	int fd;							// listening socket
+	int client;						// debugger connection, -1 if none
+	struct timespec last;			// time the socket was last looked at
+	bool stopped;					// the program waits for the debugger
+	bool report;					// stop_reply is yet to be sent
+	char stop_reply[64];			// T packet, with the watchpoint hit
+	bool stepping;					// stop after the next instruction
+	int skip_pc;					// resumed on a breakpoint there, -1 if not
+	bool patched;					// the debugger wrote memory
+	unsigned char breakpoints[MEMORY_SIZE / 8];	// one bit per address
+	int breakpoint_count;
+	Watchpoint watchpoints[GDB_MAX_WATCHPOINTS];
+	int watchpoint_count;
+	char hit[32];					// watchpoint the instruction being run hit
+	// Input from the debugger, and the packet being received from it
+	char in[GDB_PACKET_SIZE];
+	size_t in_pos, in_len;
+	char packet[GDB_PACKET_SIZE];
+	size_t size;
+	int state;
+	unsigned char checksum;
+} Gdb;
+
+Gdb *gdb_open(const char *port);
+void gdb_close(Gdb *g);
+void gdb_wait(Gdb *g);
+bool gdb_serve(Gdb *g, CPU *cpu);
+bool gdb_before(Gdb *g, const CPU *cpu);
+bool gdb_after(Gdb *g, const CPU *cpu);
+
+// Whether instructions must go one by one through the debugger
+static inline bool gdb_armed(const Gdb *g)
+{
+	return g != NULL && (g->breakpoint_count > 0 || g->watchpoint_count > 0 ||
+			g->stepping);
+}
+
+#endif
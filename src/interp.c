@@ -0,0 +1,89 @@
+// Specialized interpreters, one per quirk profile (see interp.h and quirks.h)
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "cpu.h"
+
+// Original COSMAC VIP
+#define STEP_NAME			step_vip
+#define QUIRK_SHIFT_VY		1
+#define QUIRK_MEM_I(X)		((X) + 1)
+#define QUIRK_JUMP_VX		0
+#define QUIRK_CLIP			1
+#define QUIRK_VF_RESET		1
+#define EXT_SCHIP			0
+#define EXT_XOCHIP			0
+#include "interp.h"
+#undef STEP_NAME
+#undef QUIRK_SHIFT_VY
+#undef QUIRK_MEM_I
+#undef QUIRK_JUMP_VX
+#undef QUIRK_CLIP
+#undef QUIRK_VF_RESET
+#undef EXT_SCHIP
+#undef EXT_XOCHIP
+
+// CHIP-48
+#define STEP_NAME			step_chip48
+#define QUIRK_SHIFT_VY		0
+#define QUIRK_MEM_I(X)		(X)
+#define QUIRK_JUMP_VX		1
+#define QUIRK_CLIP			0
+#define QUIRK_VF_RESET		0
+#define EXT_SCHIP			0
+#define EXT_XOCHIP			0
+#include "interp.h"
+#undef STEP_NAME
+#undef QUIRK_SHIFT_VY
+#undef QUIRK_MEM_I
+#undef QUIRK_JUMP_VX
+#undef QUIRK_CLIP
+#undef QUIRK_VF_RESET
+#undef EXT_SCHIP
+#undef EXT_XOCHIP
+
+// SUPER-CHIP 1.1
+#define STEP_NAME			step_schip
+#define QUIRK_SHIFT_VY		0
+#define QUIRK_MEM_I(X)		0
+#define QUIRK_JUMP_VX		1
+#define QUIRK_CLIP			1
+#define QUIRK_VF_RESET		0
+#define EXT_SCHIP			1
+#define EXT_XOCHIP			0
+#include "interp.h"
+#undef STEP_NAME
+#undef QUIRK_SHIFT_VY
+#undef QUIRK_MEM_I
+#undef QUIRK_JUMP_VX
+#undef QUIRK_CLIP
+#undef QUIRK_VF_RESET
+#undef EXT_SCHIP
+#undef EXT_XOCHIP
+
+// XO-CHIP (as implemented by Octo)
+#define STEP_NAME			step_xochip
+#define QUIRK_SHIFT_VY		1
+#define QUIRK_MEM_I(X)		((X) + 1)
+#define QUIRK_JUMP_VX		0
+#define QUIRK_CLIP			0
+#define QUIRK_VF_RESET		0
+#define EXT_SCHIP			1
+#define EXT_XOCHIP			1
+#include "interp.h"
+#undef STEP_NAME
+#undef QUIRK_SHIFT_VY
+#undef QUIRK_MEM_I
+#undef QUIRK_JUMP_VX
+#undef QUIRK_CLIP
+#undef QUIRK_VF_RESET
+#undef EXT_SCHIP
+#undef EXT_XOCHIP
+
+const step_fn cpu_steps[PROFILE_COUNT] = {
+	[PROFILE_VIP]		= step_vip,
+	[PROFILE_CHIP48]	= step_chip48,
+	[PROFILE_SCHIP]		= step_schip,
+	[PROFILE_XOCHIP]	= step_xochip,
+};
@@ -0,0 +1,672 @@
+// Interpreter template. Included once per quirk profile by interp.c with the
+// following macros defined, so every quirk is resolved at compile time:
+//
+//   STEP_NAME			name of the generated step function
+//   QUIRK_SHIFT_VY		8xy6/8xyE shift VY into VX instead of shifting VX
+//   QUIRK_MEM_I(X)		amount added to I by Fx55/Fx65
+//   QUIRK_JUMP_VX		Bnnn jumps to XNN + VX instead of NNN + V0
+//   QUIRK_CLIP			Dxyn clips sprites at the edges instead of wrapping
+//   QUIRK_VF_RESET		8xy1/8xy2/8xy3 reset VF
+//   EXT_SCHIP			SUPER-CHIP instructions (hires, scrolling, 16x16 sprites)
+//   EXT_XOCHIP			XO-CHIP instructions (bitplanes, long I, register ranges)
+//
+// No include guard on purpose.
+
+#if EXT_XOCHIP
+// F000 NNNN is 4 bytes long, skips jump over all of it
+#define SKIP_LENGTH(c) \
+	(((c)->memory[((c)->pc + 2) & 0xFFFF] << 8 | \
+	  (c)->memory[((c)->pc + 3) & 0xFFFF]) == 0xF000 ? 6 : 4)
+#else
+#define SKIP_LENGTH(c) 4
+#endif
+
+static bool STEP_NAME(CPU *chip8)
+{
+	unsigned short opcode;
+
+	// Update opcode
+	opcode = chip8->memory[chip8->pc] << 8 |
+		chip8->memory[(chip8->pc + 1) & 0xFFFF];
+
+	switch(opcode & 0xF000){
+		case 0x0000:
+			switch(opcode & 0x00FF){
+				case 0x00E0:
+					{
+					// Clears the screen (selected planes only).
+					gfx_clear(chip8);
+					chip8->pc += 2;
+					break;
+					}
+#if EXT_SCHIP
+				case 0x00FB:
+					{
+					// Scrolls the screen right by 4 pixels.
+					gfx_scroll(chip8, 4, 0);
+					chip8->pc += 2;
+					break;
+					}
+				case 0x00FC:
+					{
+					// Scrolls the screen left by 4 pixels.
+					gfx_scroll(chip8, -4, 0);
+					chip8->pc += 2;
+					break;
+					}
+				case 0x00FD:
+					{
+					// Exits the interpreter.
+					chip8->exit = true;
+					return false;
+					}
+				case 0x00FE:
+				case 0x00FF:
+					{
+					// Switches to low (00FE) or high (00FF) resolution. The
+					// screen is cleared since the frame buffer is kept at the
+					// current resolution.
+					chip8->hires = opcode == 0x00FF;
+					memset(&chip8->gfx, 0x00, sizeof(chip8->gfx));
+					chip8->draw = true;
+					chip8->pc += 2;
+					break;
+					}
+#endif
+				case 0x00EE:
+					{
+					// Returns from a subroutine.
+					unsigned short ret_addr = pop_stack(chip8);
+					assert(ret_addr != 0xffff);
+					chip8->pc = ret_addr;
+					break;
+					}
+				default:
+					{
+					// 0x0nnn
+					// Jump to a machine code routine at nnn.
+					// This instruction is only used on the old computers on
+					// which Chip-8 was originally implemented. It is ignored
+					// by modern interpreters.
+					unsigned short NNN = opcode & 0x0FFF;
+#if EXT_SCHIP
+					// 00Cn: scrolls the screen down by n pixels.
+					if((opcode & 0xFFF0) == 0x00C0){
+						gfx_scroll(chip8, 0, opcode & 0xF);
+						chip8->pc += 2;
+						break;
+					}
+#endif
+#if EXT_XOCHIP
+					// 00Dn: scrolls the screen up by n pixels.
+					if((opcode & 0xFFF0) == 0x00D0){
+						gfx_scroll(chip8, 0, -(opcode & 0xF));
+						chip8->pc += 2;
+						break;
+					}
+#endif
+					chip8->pc = NNN;
+					break;
+					}
+			};
+			break;
+		case 0x1000:
+			{
+			// Jumps to address NNN.
+ 			unsigned short NNN = opcode & 0x0FFF;
+			chip8->pc = NNN;
+			break;
+			}
+		case 0x2000:
+			{
+			// Calls subroutine at NNN.
+			unsigned short NNN = opcode & 0x0FFF;
+			bool s = push_stack(chip8->pc+2, chip8);
+			assert(s != false);
+
+			chip8->pc = NNN;
+			break;
+			}
+		case 0x3000:
+			{
+			// Skips the next instruction if VX equals NN.
+			// (Usually the next instruction is a jump to skip a code block)
+			unsigned int X = opcode >> 8 & 0xF;
+			unsigned short NN = opcode & 0x00FF;
+			if(chip8->V[X] == NN){
+				chip8->pc += SKIP_LENGTH(chip8);
+			} else {
+				chip8->pc += 2;
+			}
+			break;
+			}
+		case 0x4000:
+			{
+			// Skips the next instruction if VX doesn't equal NN. (Usually the
+			// next instruction is a jump to skip a code block)
+			unsigned int X = opcode >> 8 & 0xF;
+			unsigned short NN = opcode & 0x00FF;
+			if(chip8->V[X] != NN){
+				chip8->pc += SKIP_LENGTH(chip8);
+			} else{
+				chip8->pc += 2;
+			}
+			break;
+			}
+		case 0x5000:
+			{
+			// Skips the next instruction if VX equals VY. (Usually the next
+			// instruction is a jump to skip a code block)
+			unsigned int X = opcode >> 8 & 0xF;
+			unsigned int Y = opcode >> 4 & 0xF;
+#if EXT_XOCHIP
+			if((opcode & 0xF) == 0x2 || (opcode & 0xF) == 0x3){
+				// Saves (5xy2) or loads (5xy3) VX to VY in memory starting
+				// at I, in reverse order if X is bigger than Y. I itself is
+				// left unmodified.
+				int dir = X <= Y ? 1 : -1;
+				for(int i = 0, r = X; ; i++, r += dir){
+					if((opcode & 0xF) == 0x2){
+						chip8->memory[(chip8->I + i) & 0xFFFF] = chip8->V[r];
+					} else {
+						chip8->V[r] = chip8->memory[(chip8->I + i) & 0xFFFF];
+					}
+					if(r == Y) break;
+				}
+				chip8->pc += 2;
+				break;
+			}
+#endif
+			if(chip8->V[X] == chip8->V[Y]){
+				chip8->pc += SKIP_LENGTH(chip8);
+			} else {
+				chip8->pc += 2;
+			}
+			break;
+			}
+		case 0x6000:
+			{
+			// Sets VX to NN.
+			unsigned int X = opcode >> 8 & 0xF;
+			unsigned short NN = opcode & 0x00FF;
+
+			chip8->V[X] = NN;
+			chip8->pc += 2;
+			break;
+			}
+		case 0x7000:
+			{
+			// Adds NN to VX. (Carry flag is not changed)
+			unsigned int X = opcode >> 8 & 0xF;
+			unsigned short NN = opcode & 0x00FF;
+
+			chip8->V[X] += NN;
+			chip8->pc += 2;
+			break;
+			}
+		case 0x8000:
+			switch(opcode & 0x000F){
+				case 0x0:
+					{
+					// Sets VX to the value of VY.
+					unsigned int X = opcode >> 8 & 0xF;
+					unsigned int Y = opcode >> 4 & 0xF;
+					chip8->V[X] = chip8->V[Y];
+					chip8->pc += 2;
+					break;
+					}
+				case 0x1:
+					{
+					// Sets VX to VX OR VY. (Bitwise OR operation)
+					unsigned int X = opcode >> 8 & 0xF;
+					unsigned int Y = opcode >> 4 & 0xF;
+					chip8->V[X] |= chip8->V[Y];
+#if QUIRK_VF_RESET
+					chip8->V[0xF] = 0;
+#endif
+					chip8->pc += 2;
+					break;
+					}
+				case 0x2:
+					{
+					// Sets VX to VX AND VY. (Bitwise AND operation)
+					unsigned int X = opcode >> 8 & 0xF;
+					unsigned int Y = opcode >> 4 & 0xF;
+					chip8->V[X] &= chip8->V[Y];
+#if QUIRK_VF_RESET
+					chip8->V[0xF] = 0;
+#endif
+					chip8->pc += 2;
+					break;
+					}
+				case 0x3:
+					{
+					// Sets VX to VX XOR VY.
+					unsigned int X = opcode >> 8 & 0xF;
+					unsigned int Y = opcode >> 4 & 0xF;
+					chip8->V[X] ^= chip8->V[Y];
+#if QUIRK_VF_RESET
+					chip8->V[0xF] = 0;
+#endif
+					chip8->pc += 2;
+					break;
+					}
+				case 0x4:
+					{
+					// Adds VY to VX. VF is set to 1 when there's a carry, and
+					// to 0 when there isn't.
+					unsigned int X = opcode >> 8 & 0xF;
+					unsigned int Y = opcode >> 4 & 0xF;
+					// Check overflow condition
+					if(chip8->V[X] > 0 && chip8->V[Y] > (0xFF - chip8->V[X])){
+						chip8->V[0xF] = 1;
+					}
+					else {
+						chip8->V[0xF] = 0;
+					}
+					chip8->V[X] += chip8->V[Y];
+					chip8->pc += 2;
+					break;
+					}
+				case 0x5:
+					{
+					// VY is subtracted from VX. VF is set to 0 when there's a
+					// borrow, and 1 when there isn't.
+					unsigned int X = opcode >> 8 & 0xF;
+					unsigned int Y = opcode >> 4 & 0xF;
+					// Check overflow condition
+					if(chip8->V[X] < chip8->V[Y]){
+						chip8->V[0xF] = 0;
+					}
+					else {
+						chip8->V[0xF] = 1;
+					}
+					chip8->V[X] -= chip8->V[Y];
+					chip8->pc += 2;
+					break;
+					}
+				case 0x6:
+					{
+					// Stores the least significant bit of VX (VY on the VIP)
+					// in VF and then shifts it to the right by 1 into VX.
+					unsigned int X = opcode >> 8 & 0xF;
+#if QUIRK_SHIFT_VY
+					unsigned int Y = opcode >> 4 & 0xF;
+					chip8->V[0xF] = chip8->V[Y] & 0x1;
+					chip8->V[X] = chip8->V[Y] >> 1;
+#else
+					chip8->V[0xF] = chip8->V[X] & 0x1;
+					chip8->V[X] >>= 1;
+#endif
+					chip8->pc += 2;
+					break;
+					}
+				case 0x7:
+					{
+					// Sets VX to VY minus VX. VF is set to 0 when there's a
+					// borrow, and 1 when there isn't.
+					unsigned int X = opcode >> 8 & 0xF;
+					unsigned int Y = opcode >> 4 & 0xF;
+					if(chip8->V[X] > chip8->V[Y]){
+						chip8->V[0xF] = 0;
+					} else {
+						chip8->V[0xF] = 1;
+					}
+					chip8->V[X] = chip8->V[Y] - chip8->V[X];
+					chip8->pc += 2;
+					break;
+					}
+				case 0xE:
+					{
+					// Stores the most significant bit of VX (VY on the VIP)
+					// in VF and then shifts it to the left by 1 into VX.
+					unsigned int X = opcode >> 8 & 0xF;
+#if QUIRK_SHIFT_VY
+					unsigned int Y = opcode >> 4 & 0xF;
+					chip8->V[0xF] = chip8->V[Y] >> 0x7;
+					chip8->V[X] = chip8->V[Y] << 1;
+#else
+					chip8->V[0xF] = chip8->V[X] >> 0x7;
+					chip8->V[X] <<= 1;
+#endif
+					chip8->pc += 2;
+					break;
+					}
+				default:
+					return false;
+			};
+			break;
+		case 0x9000:
+			{
+			// Skips the next instruction if VX doesn't equal VY. (Usually the
+			// next instruction is a jump to skip a code block)
+			unsigned int X = opcode >> 8 & 0xF;
+			unsigned int Y = opcode >> 4 & 0xF;
+			if(chip8->V[X] != chip8->V[Y]){
+				chip8->pc += SKIP_LENGTH(chip8);
+			} else {
+				chip8->pc += 2;
+			}
+			break;
+			}
+		case 0xa000:
+			{
+			// Sets I to the address NNN.
+			unsigned short NNN = opcode & 0x0FFF;
+			chip8->I = NNN;
+			chip8->pc += 2;
+			break;
+			}
+		case 0xb000:
+			{
+			// Jumps to the address NNN plus V0 (XNN plus VX on the HP-48
+			// interpreters).
+			unsigned short NNN = opcode & 0x0FFF;
+#if QUIRK_JUMP_VX
+			chip8->pc = chip8->V[opcode >> 8 & 0xF] + NNN;
+#else
+			chip8->pc = chip8->V[0] + NNN;
+#endif
+			break;
+			}
+		case 0xc000:
+			{
+		  	// Sets VX to the result of a bitwise and operation on a random
+		  	// number (Typically: 0 to 255) and NN.
+			unsigned int X = opcode >> 8 & 0x0F;
+			unsigned short NN = opcode & 0xFF;
+			unsigned int r = cpu_random(chip8) % 0xFF;
+
+			chip8->V[X] = r & NN;
+			chip8->pc += 2;
+			break;
+			}
+		case 0xd000:
+			{
+			// Draws a sprite at coordinate (VX, VY) that has a width of 8
+			// pixels and a height of N pixels (16x16 when N is 0 on
+			// SUPER-CHIP). Each row of pixels is read as bit-coded starting
+			// from memory location I; I value doesn’t change after the
+			// execution of this instruction. VF is set to 1 if any screen
+			// pixels are flipped from set to unset when the sprite is drawn,
+			// and to 0 if that doesn’t happen. The starting position always
+			// wraps around the screen, the part of the sprite that goes past
+			// the edge is either clipped or wrapped depending on the profile.
+			// Every selected plane gets its own sprite data, one after the
+			// other (XO-CHIP).
+			unsigned int width = SCREEN_WIDTH(chip8);
+			unsigned int height = SCREEN_HEIGHT(chip8);
+			unsigned int x = chip8->V[opcode >> 8 & 0xF] & (width - 1);
+			unsigned int y = chip8->V[opcode >> 4 & 0xF] & (height - 1);
+			unsigned int N = opcode & 0xF;
+			unsigned int bytes = 1;
+#if EXT_SCHIP
+			if(N == 0){
+				N = 16;
+				bytes = 2;
+			}
+#endif
+			unsigned short addr = chip8->I;
+
+			chip8->V[0xF] = 0;
+			for(int p = 0; p < GFX_PLANES; p++){
+				if(!(chip8->planes & (1 << p))){
+					continue;
+				}
+				for(int ydepth = 0; ydepth < N; ydepth++, addr += bytes){
+					unsigned int row = y + ydepth;
+#if QUIRK_CLIP
+					if(row >= height) continue;
+#else
+					row &= height - 1;
+#endif
+					// Sprite row left aligned on 16 bits, then moved to x
+					// as a whole (one XOR per word instead of per pixel)
+					unsigned int pixel_line = chip8->memory[addr] << 8;
+					if(bytes == 2){
+						pixel_line |= chip8->memory[(addr + 1) & 0xFFFF];
+					}
+					uint64_t hi, lo;
+					if(width == 64){
+						uint64_t v = (uint64_t)pixel_line << 48;
+						hi = v >> x;
+#if !QUIRK_CLIP
+						if(x) hi |= v << (64 - x);
+#endif
+						lo = 0;
+					} else {
+						unsigned __int128 v = (unsigned __int128)pixel_line << 112;
+						unsigned __int128 r = v >> x;
+#if !QUIRK_CLIP
+						if(x) r |= v << (128 - x);
+#endif
+						hi = r >> 64;
+						lo = (uint64_t)r;
+					}
+
+					uint64_t *line = chip8->gfx[p][row];
+					if((line[0] & hi) || (line[1] & lo)){
+						chip8->V[0xF] = 1;
+					}
+					line[0] ^= hi;
+					line[1] ^= lo;
+				}
+			}
+			chip8->draw = true;
+			chip8->pc += 2;
+			break;
+			}
+		case 0xe000:
+			switch(opcode & 0xFF){
+				case 0x9E:
+					{
+					// Skips the next instruction if the key stored in VX is
+					// pressed. (Usually the next instruction is a jump to skip
+					// a code block)
+					unsigned int X = opcode >> 8 & 0xF;
+					if(chip8->input[chip8->V[X] & 0xF] != 0x0){
+						chip8->pc += SKIP_LENGTH(chip8);
+					} else {
+						chip8->pc += 2;
+					}
+					break;
+					}
+				case 0xA1:
+					{
+					// Skips the next instruction if the key stored in VX isn't
+					// pressed. (Usually the next instruction is a jump to skip
+					// a code block)
+					unsigned int X = opcode >> 8 & 0xF;
+					if(chip8->input[chip8->V[X] & 0xF] == 0x0){
+						chip8->pc += SKIP_LENGTH(chip8);
+					} else {
+						chip8->pc += 2;
+					}
+					break;
+					}
+				default:
+					return false;
+			}
+			break;
+		case 0xf000:
+			switch(opcode & 0x00FF){
+#if EXT_XOCHIP
+				case 0x0000:
+					{
+					// F000 NNNN: sets I to the 16 bit address NNNN.
+					if(opcode != 0xF000){
+						return false;
+					}
+					chip8->I = chip8->memory[(chip8->pc + 2) & 0xFFFF] << 8 |
+						chip8->memory[(chip8->pc + 3) & 0xFFFF];
+					chip8->pc += 4;
+					break;
+					}
+				case 0x0001:
+					{
+					// Selects the planes (bitmask in X) drawn, scrolled and
+					// cleared by the display instructions.
+					chip8->planes = opcode >> 8 & 0x3;
+					chip8->pc += 2;
+					break;
+					}
+				case 0x0002:
+					{
+					// Loads the 16 bytes audio pattern from memory at I.
+					for(int i = 0; i < 16; i++){
+						chip8->pattern[i] = chip8->memory[(chip8->I + i) & 0xFFFF];
+					}
+					chip8->has_pattern = true;
+					chip8->pc += 2;
+					break;
+					}
+				case 0x003A:
+					{
+					// Sets the audio pattern playback pitch to VX.
+					unsigned int X = opcode >> 8 & 0xF;
+					chip8->pitch = chip8->V[X];
+					chip8->pc += 2;
+					break;
+					}
+#endif
+				case 0x0007:
+					{
+					// Sets VX to the value of the delay timer.
+					unsigned int X = opcode >> 8 & 0xF;
+					chip8->V[X] = chip8->delay_timer;
+					chip8->pc += 2;
+					break;
+					}
+				case 0x000A:
+					{
+					// A key press is awaited, and then stored in VX.
+					// (Blocking Operation. The instruction runs again until
+					// a key event comes in, timers keep counting meanwhile)
+					unsigned int X = opcode >> 8 & 0xF;
+					if(chip8->key_is_pressed == false){
+						break;
+					}
+					for(int k = 0; k < 16; k++){
+						if(chip8->input[k] != 0x0){
+							chip8->V[X] = k;
+						}
+					}
+					chip8->pc+= 2;
+					break;
+					}
+				case 0x0015:
+					{
+					// Sets the delay timer to VX..
+					unsigned int X = opcode >> 8 & 0xF;
+					chip8->delay_timer = chip8->V[X];
+					chip8->pc += 2;
+					break;
+					}
+				case 0x0018:
+					{
+					// Sets the sound timer to VX.
+					unsigned int X = opcode >> 8 & 0xF;
+					chip8->sound_timer = chip8->V[X];
+					chip8->pc += 2;
+					break;
+					}
+				case 0x001e:
+					{
+					// Adds VX to I. VF is not affected.
+					unsigned int X = opcode >> 8 & 0xF;
+					chip8->I += chip8->V[X];
+					chip8->pc += 2;
+					break;
+					}
+				case 0x0029:
+					{
+					// Sets I to the location of the sprite for the character
+					// in VX. Characters 0-F (in hexadecimal) are represented
+					// by a 4x5 font.
+					unsigned int X = opcode >> 8 & 0xF;
+					chip8->I = FONT_SMALL + ((chip8->V[X] & 0xF) << 4);
+					chip8->pc += 2;
+					break;
+					}
+#if EXT_SCHIP
+				case 0x0030:
+					{
+					// Sets I to the location of the 8x10 sprite for the
+					// character in VX.
+					unsigned int X = opcode >> 8 & 0xF;
+					chip8->I = FONT_BIG + (chip8->V[X] & 0xF) * 10;
+					chip8->pc += 2;
+					break;
+					}
+				case 0x0075:
+					{
+					// Stores V0 to VX (including VX) in the user flags.
+					unsigned int X = opcode >> 8 & 0xF;
+					memcpy(chip8->rpl, chip8->V, X + 1);
+					chip8->pc += 2;
+					break;
+					}
+				case 0x0085:
+					{
+					// Fills V0 to VX (including VX) from the user flags.
+					unsigned int X = opcode >> 8 & 0xF;
+					memcpy(chip8->V, chip8->rpl, X + 1);
+					chip8->pc += 2;
+					break;
+					}
+#endif
+				case 0x0033:
+					{
+					// Stores the binary-coded decimal representation of VX,
+					// with the most significant of three digits at the address
+					// in I, the middle digit at I plus 1, and the least
+					// significant digit at I plus 2. (In other words, take the
+					// decimal representation of VX, place the hundreds digit
+					// in memory at location in I, the tens digit at location
+					// I+1, and the ones digit at location I+2.)
+					unsigned int X = opcode >> 8 & 0x0F;
+					chip8->memory[chip8->I]	 = chip8->V[X] / 100;
+					chip8->memory[(chip8->I+1) & 0xFFFF] = (chip8->V[X] % 100) / 10;
+					chip8->memory[(chip8->I+2) & 0xFFFF] = chip8->V[X] % 10;
+					chip8->pc += 2;
+					break;
+					};
+				case 0x0055:
+					{
+					// Stores V0 to VX (including VX) in memory starting at
+					// address I. The offset from I is increased by 1 for each
+					// value written, I itself is moved according to the
+					// profile.
+					unsigned int X = opcode >> 8 & 0x0F;
+					for(int i = 0; i <= X; i++){
+						chip8->memory[(chip8->I + i) & 0xFFFF] = chip8->V[i];
+					}
+					chip8->I += QUIRK_MEM_I(X);
+					chip8->pc += 2;
+					break;
+					}
+				case 0x0065:
+					{
+					// Fills V0 to VX (including VX) with values from memory
+					// starting at address I. The offset from I is increased by
+					// 1 for each value written, I itself is moved according
+					// to the profile.
+					unsigned int X = opcode >> 8 & 0xF;
+					for(int i = 0; i <= X; i++){
+						chip8->V[i] = chip8->memory[(chip8->I + i) & 0xFFFF];
+					}
+					chip8->I += QUIRK_MEM_I(X);
+					chip8->pc += 2;
+					break;
+					}
+
+				default:
+					return false;
+			}
+			break;
+		}
+
+	return true;
+}
+
+#undef SKIP_LENGTH
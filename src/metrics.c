@@ -0,0 +1,156 @@
+// Live metrics in shared memory (see metrics.h)
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "metrics.h"
+
+static void segment_name(pid_t pid, char *name, size_t n)
+{
+	snprintf(name, n, "/" METRICS_PREFIX "%d", (int)pid);
+}
+
+// Creates the segment of this process. Returns NULL on failure.
+Metrics *metrics_open()
+{
+	char name[64];
+	segment_name(getpid(), name, sizeof(name));
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0){
+		return NULL;
+	}
+	if(ftruncate(fd, sizeof(Metrics)) < 0){
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+	Metrics *m = mmap(NULL, sizeof(Metrics), PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	close(fd);
+	if(m == MAP_FAILED){
+		shm_unlink(name);
+		return NULL;
+	}
+	// ftruncate zeroed the rest
+	m->pid = getpid();
+	m->magic = METRICS_MAGIC;
+	return m;
+}
+
+// Removes the segment, readers still attached keep the last values
+void metrics_close(Metrics *m)
+{
+	if(m == NULL){
+		return;
+	}
+	char name[64];
+	segment_name(m->pid, name, sizeof(name));
+	munmap(m, sizeof(Metrics));
+	shm_unlink(name);
+}
+
+// Maps the segment of an emulator read only. Returns NULL if there's none.
+Metrics *metrics_attach(pid_t pid)
+{
+	char name[64];
+	segment_name(pid, name, sizeof(name));
+	int fd = shm_open(name, O_RDONLY, 0);
+	if(fd < 0){
+		return NULL;
+	}
+	Metrics *m = mmap(NULL, sizeof(Metrics), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(m == MAP_FAILED){
+		return NULL;
+	}
+	if(m->magic != METRICS_MAGIC){
+		munmap(m, sizeof(Metrics));
+		return NULL;
+	}
+	return m;
+}
+
+// Takes a consistent copy. Returns false if the emulator kept writing.
+bool metrics_read(const Metrics *m, Metrics *copy)
+{
+	for(int tries = 0; tries < 1000; tries++){
+		unsigned int seq = atomic_load_explicit(&m->seq, memory_order_acquire);
+		if(seq & 1){
+			sched_yield();
+			continue;
+		}
+		memcpy(copy, (const void *)m, sizeof(Metrics));
+		atomic_thread_fence(memory_order_acquire);
+		if(atomic_load_explicit(&m->seq, memory_order_relaxed) == seq){
+			return true;
+		}
+	}
+	return false;
+}
+
+// Writes go between metrics_begin and metrics_end
+void metrics_begin(Metrics *m)
+{
+	atomic_store_explicit(&m->seq, m->seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+void metrics_end(Metrics *m)
+{
+	atomic_store_explicit(&m->seq, m->seq + 1, memory_order_release);
+}
+
+uint64_t metrics_now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// Histogram bucket of a frame time: the microseconds themselves below 16,
+// then the top 5 bits
+int metrics_bucket(uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	if(us < 16){
+		return us;
+	}
+	int e = 63 - __builtin_clzll(us);
+	int bucket = (e - 3) * 16 + (us >> (e - 4) & 15);
+	return bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1;
+}
+
+// Smallest frame time of a bucket
+uint64_t metrics_bucket_ns(int bucket)
+{
+	if(bucket < 16){
+		return bucket * 1000ULL;
+	}
+	int e = bucket / 16 + 3;
+	return ((uint64_t)(16 + bucket % 16) << (e - 4)) * 1000;
+}
+
+// Frame time under which p (0-1) of the frames fall, the middle of its
+// bucket
+uint64_t metrics_percentile(const Metrics *m, double p)
+{
+	uint64_t total = 0;
+	for(int i = 0; i < METRICS_BUCKETS; i++){
+		total += m->histogram[i];
+	}
+	if(total == 0){
+		return 0;
+	}
+	uint64_t rank = p * total, seen = 0;
+	for(int i = 0; i < METRICS_BUCKETS - 1; i++){
+		seen += m->histogram[i];
+		if(seen > rank){
+			return (metrics_bucket_ns(i) + metrics_bucket_ns(i + 1)) / 2;
+		}
+	}
+	return metrics_bucket_ns(METRICS_BUCKETS - 1);
+}
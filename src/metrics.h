@@ -0,0 +1,53 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+// Live metrics (-m), published once per frame in the shared memory segment
+// /dev/shm/yac8e.<pid> for yac8e-stat. There is a single writer, readers
+// never lock it: seq is odd while a frame is being written, and a reader
+// keeps its copy only if seq was even and unchanged around it.
+#define METRICS_PREFIX "yac8e."
+#define METRICS_MAGIC 0x38433301		// 'C8', version 1
+// Frame time histogram: 16 buckets per power of two microseconds, each one
+// at most 6% wide, up to about 30 seconds
+#define METRICS_BUCKETS 368
+
+typedef struct {
+	uint32_t magic;
+	atomic_uint seq;
+	pid_t pid;
+	char rom[96];					// file name and quirk profile
+	uint64_t instructions;			// executed
+	uint64_t ips;					// instructions per second of real time
+	uint64_t frames;				// emulated
+	uint64_t presented;				// drawn (turbo skips the others)
+	uint64_t frame_rate;			// frames emulated per second
+	uint32_t ipf;
+	bool turbo;
+	uint64_t emulate_ns;			// time spent running instructions
+	uint64_t draw_ns;				// time spent drawing and streaming
+	uint64_t late;					// frames that started past their time
+	uint64_t stream_dropped;		// frames slow spectators missed
+	uint64_t audio_dropped;			// frames the sound card missed
+	uint64_t keys;					// key events read
+	uint32_t input_depth;			// key events since the previous frame
+	uint32_t input_max;
+	uint64_t histogram[METRICS_BUCKETS];	// frame start to next start
+} Metrics;
+
+Metrics *metrics_open();
+void metrics_close(Metrics *m);
+Metrics *metrics_attach(pid_t pid);
+bool metrics_read(const Metrics *m, Metrics *copy);
+void metrics_begin(Metrics *m);
+void metrics_end(Metrics *m);
+uint64_t metrics_now();
+int metrics_bucket(uint64_t ns);
+uint64_t metrics_bucket_ns(int bucket);
+uint64_t metrics_percentile(const Metrics *m, double p);
+
+#endif
@@ -0,0 +1,55 @@
+// Lookup of the ROMs translated by c8rec, and the checks that tell when the
+// translation stops matching memory.
+#include <stddef.h>
+
+#include "native.h"
+
+#ifndef HAVE_NATIVE
+// Plain build: no translated ROMs, everything runs in the interpreters
+const NativeROM *native_roms[] = { NULL };
+#endif
+
+// Returns the translation of a ROM for a profile, or NULL
+const NativeROM *native_find(uint64_t hash, Profile profile)
+{
+	for(int i = 0; native_roms[i] != NULL; i++){
+		if(native_roms[i]->hash == hash && native_roms[i]->profile == profile){
+			return native_roms[i];
+		}
+	}
+	return NULL;
+}
+
+// Whether any of the len bytes at addr belongs to a translated instruction
+bool native_covers(const unsigned char *code, unsigned int addr,
+		unsigned int len)
+{
+	for(unsigned int i = 0; i < len; i++){
+		unsigned int a = (addr + i) & 0xFFFF;
+		if(code[a >> 3] >> (a & 7) & 1){
+			return true;
+		}
+	}
+	return false;
+}
+
+// Whether the instruction at pc (run by the interpreter) is about to write
+// over translated code
+bool native_clobbers(const NativeROM *rom, const CPU *cpu)
+{
+	unsigned short opcode = cpu->memory[cpu->pc] << 8 |
+		cpu->memory[(cpu->pc + 1) & 0xFFFF];
+	unsigned int X = opcode >> 8 & 0xF;
+	unsigned int Y = opcode >> 4 & 0xF;
+
+	switch(opcode & 0xF0FF){
+		case 0xF033:
+			return native_covers(rom->code, cpu->I, 3);
+		case 0xF055:
+			return native_covers(rom->code, cpu->I, X + 1);
+	}
+	if(rom->profile == PROFILE_XOCHIP && (opcode & 0xF00F) == 0x5002){
+		return native_covers(rom->code, cpu->I, (X > Y ? X - Y : Y - X) + 1);
+	}
+	return false;
+}
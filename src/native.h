@@ -0,0 +1,33 @@
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cpu.h"
+#include "quirks.h"
+
+// ROMs translated ahead of time to C by c8rec. The plain build has none,
+// `make native` links the code generated for NATIVE_ROMS and builds with
+// HAVE_NATIVE.
+typedef struct {
+	uint64_t hash;					// ROM the code was generated from
+	const char *name;				// file name of the ROM
+	Profile profile;				// quirks the code was generated for
+	const unsigned char *code;		// bitmap of the translated bytes
+	// Runs up to n instructions from chip8->pc and returns how many are
+	// left. Stops early (pc set) where the translation can't go: untranslated
+	// addresses, blocks longer than what is left, or stores into translated
+	// code, which also set *stale.
+	int (*run)(CPU *chip8, int n, bool *stale);
+} NativeROM;
+
+// NULL terminated
+extern const NativeROM *native_roms[];
+
+const NativeROM *native_find(uint64_t hash, Profile profile);
+bool native_covers(const unsigned char *code, unsigned int addr,
+		unsigned int len);
+bool native_clobbers(const NativeROM *rom, const CPU *cpu);
+
+#endif
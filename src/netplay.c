@@ -0,0 +1,377 @@
+// Rollback netplay (see netplay.h)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "netplay.h"
+
+#define HELLO_SIZE 20
+#define INPUT_SIZE 7
+#define HASH_SIZE 13
+
+static void put_le(unsigned char *p, uint64_t value, int bytes)
+{
+	for(int i = 0; i < bytes; i++){
+		p[i] = value >> (i * 8);
+	}
+}
+
+static uint64_t get_le(const unsigned char *p, int bytes)
+{
+	uint64_t value = 0;
+	for(int i = bytes - 1; i >= 0; i--){
+		value = value << 8 | p[i];
+	}
+	return value;
+}
+
+static bool read_full(int fd, unsigned char *buf, size_t n)
+{
+	while(n > 0){
+		ssize_t r = read(fd, buf, n);
+		if(r <= 0){
+			return false;
+		}
+		buf += r;
+		n -= r;
+	}
+	return true;
+}
+
+static bool write_full(int fd, const unsigned char *buf, size_t n)
+{
+	while(n > 0){
+		ssize_t w = send(fd, buf, n, MSG_NOSIGNAL);
+		if(w <= 0){
+			return false;
+		}
+		buf += w;
+		n -= w;
+	}
+	return true;
+}
+
+static void hello(unsigned char *msg, uint64_t rom_hash, int ipf,
+		uint32_t seed)
+{
+	memcpy(msg, "C8NP", 4);
+	put_le(msg + 4, rom_hash, 8);
+	put_le(msg + 12, ipf, 4);
+	put_le(msg + 16, seed, 4);
+}
+
+static Netplay *new_netplay(int fd)
+{
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	Netplay *n = calloc(1, sizeof(Netplay));
+	assert(n != NULL);
+	n->fd = fd;
+	memset(n->hashed, 0xFF, sizeof(n->hashed));
+	return n;
+}
+
+// Waits for the other player on port, and tells it the clock rate and the
+// random seed. Returns NULL (errno set) on failure.
+Netplay *netplay_host(const char *port, uint64_t rom_hash, int *ipf,
+		uint32_t *seed)
+{
+	int p = atoi(port);
+	if(p <= 0 || p > 0xFFFF){
+		errno = EINVAL;
+		return NULL;
+	}
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if(fd < 0){
+		return NULL;
+	}
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	struct sockaddr_in in;
+	memset(&in, 0x0, sizeof(in));
+	in.sin_family = AF_INET;
+	in.sin_port = htons(p);
+	in.sin_addr.s_addr = htonl(INADDR_ANY);
+	if(bind(fd, (struct sockaddr *)&in, sizeof(in)) < 0 || listen(fd, 1) < 0){
+		close(fd);
+		return NULL;
+	}
+	fprintf(stderr, "Waiting for the other player on port %d...\n", p);
+	int client = accept(fd, NULL, NULL);
+	close(fd);
+	if(client < 0){
+		return NULL;
+	}
+
+	unsigned char msg[HELLO_SIZE];
+	hello(msg, rom_hash, *ipf, *seed);
+	if(!write_full(client, msg, HELLO_SIZE) || !read_full(client, msg, 12)){
+		close(client);
+		errno = ECONNRESET;
+		return NULL;
+	}
+	if(memcmp(msg, "C8NP", 4) != 0 || get_le(msg + 4, 8) != rom_hash){
+		close(client);
+		errno = EPROTO;
+		return NULL;
+	}
+	return new_netplay(client);
+}
+
+// Connects to the host at [host:]port, and takes its clock rate and random
+// seed. Returns NULL (errno set) on failure.
+Netplay *netplay_join(const char *addr, uint64_t rom_hash, int *ipf,
+		uint32_t *seed)
+{
+	char host[256] = "127.0.0.1";
+	const char *port = addr;
+	const char *colon = strrchr(addr, ':');
+	if(colon != NULL){
+		snprintf(host, sizeof(host), "%.*s", (int)(colon - addr), addr);
+		port = colon + 1;
+	}
+	struct addrinfo hints, *res;
+	memset(&hints, 0x0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if(getaddrinfo(host, port, &hints, &res) != 0){
+		errno = EINVAL;
+		return NULL;
+	}
+	int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if(fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) < 0){
+		if(fd >= 0){
+			close(fd);
+		}
+		freeaddrinfo(res);
+		return NULL;
+	}
+	freeaddrinfo(res);
+
+	unsigned char msg[HELLO_SIZE];
+	if(!read_full(fd, msg, HELLO_SIZE)){
+		close(fd);
+		errno = ECONNRESET;
+		return NULL;
+	}
+	if(memcmp(msg, "C8NP", 4) != 0 || get_le(msg + 4, 8) != rom_hash){
+		// The host finds out on its own
+		close(fd);
+		errno = EPROTO;
+		return NULL;
+	}
+	*ipf = get_le(msg + 12, 4);
+	*seed = get_le(msg + 16, 4);
+	hello(msg, rom_hash, *ipf, *seed);
+	if(!write_full(fd, msg, 12)){
+		close(fd);
+		errno = ECONNRESET;
+		return NULL;
+	}
+	return new_netplay(fd);
+}
+
+void netplay_close(Netplay *n)
+{
+	if(n == NULL){
+		return;
+	}
+	if(n->fd >= 0){
+		close(n->fd);
+	}
+	free(n);
+}
+
+// The other player left: the game goes on alone, with none of its keys
+static void hang_up(Netplay *n)
+{
+	close(n->fd);
+	n->fd = -1;
+	n->remote = 0;
+}
+
+static void send_message(Netplay *n, const unsigned char *msg, size_t size)
+{
+	if(n->fd >= 0 && !write_full(n->fd, msg, size)){
+		hang_up(n);
+	}
+}
+
+// Counts a desynchronization when both sides hashed the same frame
+static void compare_hashes(Netplay *n, int i)
+{
+	if(n->hashed[0][i] != n->hashed[1][i] ||
+			n->hashed[0][i] == (unsigned long)-1){
+		return;
+	}
+	if(n->hashes[0][i] != n->hashes[1][i]){
+		n->desyncs++;
+	}
+	n->hashed[1][i] = -1;
+}
+
+// FNV-1a of a CPU at the start of a frame. The draw flag only tells whether
+// the screen was presented since, which differs between the machines.
+static uint64_t hash_cpu(const CPU *cpu)
+{
+	static CPU copy;
+	copy = *cpu;
+	copy.draw = false;
+	const unsigned char *p = (const unsigned char *)&copy;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for(size_t i = 0; i < sizeof(copy); i++){
+		hash = (hash ^ p[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+// Hashes and sends the states all inputs of which are now known
+static void check(Netplay *n)
+{
+	unsigned long f;
+	while((f = n->checked) < n->confirmed && f < n->frame && n->fd >= 0){
+		int i = f / NETPLAY_CHECK_EVERY % NETPLAY_HASHES;
+		n->hashes[0][i] = hash_cpu(&n->snapshots[f % NETPLAY_WINDOW]);
+		n->hashed[0][i] = f;
+		unsigned char msg[HASH_SIZE];
+		msg[0] = 'H';
+		put_le(msg + 1, f, 4);
+		put_le(msg + 5, n->hashes[0][i], 8);
+		send_message(n, msg, HASH_SIZE);
+		compare_hashes(n, i);
+		n->checked += NETPLAY_CHECK_EVERY;
+	}
+}
+
+// Takes in the messages of the other player. Returns the first frame that
+// ran with a wrong prediction, or n->frame.
+static unsigned long receive(Netplay *n)
+{
+	unsigned long wrong = n->frame;
+	while(n->fd >= 0){
+		ssize_t r = recv(n->fd, n->in + n->in_len, sizeof(n->in) - n->in_len,
+				MSG_DONTWAIT);
+		if(r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+					errno != EINTR)){
+			hang_up(n);
+			break;
+		}
+		if(r < 0){
+			break;
+		}
+		n->in_len += r;
+
+		size_t used = 0;
+		while(used < n->in_len){
+			unsigned char *msg = n->in + used;
+			size_t size = msg[0] == 'I' ? INPUT_SIZE : HASH_SIZE;
+			if(msg[0] != 'I' && msg[0] != 'H'){
+				hang_up(n);
+				return wrong;
+			}
+			if(n->in_len - used < size){
+				break;
+			}
+			used += size;
+			unsigned long f = get_le(msg + 1, 4);
+			if(msg[0] == 'H'){
+				int i = f / NETPLAY_CHECK_EVERY % NETPLAY_HASHES;
+				n->hashes[1][i] = get_le(msg + 5, 8);
+				n->hashed[1][i] = f;
+				compare_hashes(n, i);
+				continue;
+			}
+			// Inputs come in order, one per frame
+			uint16_t keys = get_le(msg + 5, 2);
+			int i = f % (2 * NETPLAY_WINDOW);
+			if(f < n->frame && keys != n->used[i] && f < wrong){
+				wrong = f;
+			}
+			n->used[i] = keys;
+			n->remote = keys;
+			n->confirmed = f + 1;
+		}
+		memmove(n->in, n->in + used, n->in_len - used);
+		n->in_len -= used;
+	}
+	return wrong;
+}
+
+static void set_keys(CPU *cpu, uint16_t keys)
+{
+	for(int k = 0; k < 16; k++){
+		cpu->input[k] = keys >> k & 1;
+	}
+	cpu->key_is_pressed = keys != 0;
+}
+
+// Runs frame n->frame with the local keys, after running again the frames
+// the other player's keys were mispredicted for. Returns false, running
+// nothing, while too far ahead of the other player after waiting up to
+// NETPLAY_STALL_MS for its keys.
+bool netplay_advance(Netplay *n, CPU *cpu, uint16_t keys, frame_fn run)
+{
+	while(1){
+		unsigned long wrong = receive(n);
+		if(wrong < n->frame){
+			n->rollbacks++;
+			*cpu = n->snapshots[wrong % NETPLAY_WINDOW];
+			for(unsigned long f = wrong; f < n->frame; f++){
+				int i = f % NETPLAY_WINDOW, j = f % (2 * NETPLAY_WINDOW);
+				if(f >= n->confirmed){
+					// Still unknown, a better guess now
+					n->used[j] = n->remote;
+				}
+				n->snapshots[i] = *cpu;
+				set_keys(cpu, n->local[i] | n->used[j]);
+				run(cpu);
+				n->replayed++;
+			}
+		}
+		check(n);
+
+		if(n->fd < 0 || n->frame < n->confirmed + NETPLAY_WINDOW){
+			break;
+		}
+		if(!n->stalled){
+			n->stalled = true;
+			n->stalls++;
+		}
+		// Wait for the other player's keys instead of coming back right
+		// away, turbo doesn't sleep between frames
+		struct pollfd p = {.fd = n->fd, .events = POLLIN};
+		if(poll(&p, 1, NETPLAY_STALL_MS) <= 0){
+			return false;
+		}
+	}
+	n->stalled = false;
+
+	int i = n->frame % NETPLAY_WINDOW;
+	n->local[i] = keys;
+	unsigned char msg[INPUT_SIZE];
+	msg[0] = 'I';
+	put_le(msg + 1, n->frame, 4);
+	put_le(msg + 5, keys, 2);
+	send_message(n, msg, INPUT_SIZE);
+	int j = n->frame % (2 * NETPLAY_WINDOW);
+	if(n->frame >= n->confirmed){
+		n->used[j] = n->remote;
+	}
+	n->snapshots[i] = *cpu;
+	set_keys(cpu, keys | n->used[j]);
+	run(cpu);
+	n->frame++;
+	check(n);
+	return true;
+}
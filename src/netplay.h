@@ -0,0 +1,67 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cpu.h"
+
+// Two player netplay over TCP, with rollback. Both machines run the same ROM
+// from the same state, and every frame only depends on the keys pressed on
+// both sides (the keypad is shared: a key is down if either player holds
+// it).
+//
+// A frame runs as soon as the local keys are known, with the other player's
+// keys predicted to be the last ones received. When the real ones arrive and
+// differ, the CPU goes back to its copy from the start of that frame and the
+// frames since are run again. A machine more than NETPLAY_WINDOW frames
+// ahead of what it heard from the other waits for it.
+//
+// Messages, little endian:
+//   hello		"C8NP", ROM hash (8 bytes), instructions per frame (4, 0 for
+//				VIP timing), random seed (4) from the host; the guest answers
+//				with "C8NP" and its ROM hash
+//   'I'		frame (4), keys (2): the keys of a player for a frame
+//   'H'		frame (4), hash (8): state at the start of a frame all inputs
+//				of which are known, to tell desynchronizations
+#define NETPLAY_WINDOW 8
+#define NETPLAY_CHECK_EVERY 60
+#define NETPLAY_HASHES 16
+// Longest wait for the other player's keys before the frame is given up
+// (a 60 Hz frame)
+#define NETPLAY_STALL_MS 16
+
+// Runs one frame of the machine, with cpu->input already set
+typedef void (*frame_fn)(CPU *cpu);
+
+typedef struct {
+	int fd;							// connection, -1 once the other left
+	unsigned long frame;			// next frame to run
+	unsigned long confirmed;		// frames the other player's keys are known
+	uint16_t local[NETPLAY_WINDOW];	// keys of the frames not confirmed yet
+	// Keys of the other player, predicted or received. It may be up to a
+	// window ahead, its keys mustn't take the place of those to run again.
+	uint16_t used[2 * NETPLAY_WINDOW];
+	uint16_t remote;				// last keys received
+	unsigned long checked;			// next frame to hash
+	CPU snapshots[NETPLAY_WINDOW];	// CPU at the start of those frames
+	// State hashes of both sides, by frame / NETPLAY_CHECK_EVERY
+	uint64_t hashes[2][NETPLAY_HASHES];
+	unsigned long hashed[2][NETPLAY_HASHES];
+	unsigned char in[64];			// message being received
+	size_t in_len;
+	unsigned long rollbacks;		// wrong predictions
+	unsigned long replayed;			// frames run again because of them
+	bool stalled;					// n->frame waits for the other player
+	unsigned long stalls;			// frames that waited for the other
+	unsigned long desyncs;			// state hashes that didn't match
+} Netplay;
+
+Netplay *netplay_host(const char *port, uint64_t rom_hash, int *ipf,
+		uint32_t *seed);
+Netplay *netplay_join(const char *addr, uint64_t rom_hash, int *ipf,
+		uint32_t *seed);
+void netplay_close(Netplay *n);
+bool netplay_advance(Netplay *n, CPU *cpu, uint16_t keys, frame_fn run);
+
+#endif
@@ -0,0 +1,155 @@
+// Quirk profile selection: a small database of known ROM hashes, with a
+// fallback that looks at the opcodes the ROM uses.
+#include <string.h>
+#include <stdbool.h>
+
+#include "quirks.h"
+#include "cpu.h"
+
+const char *profile_names[PROFILE_COUNT] = {
+	[PROFILE_VIP]		= "vip",
+	[PROFILE_CHIP48]	= "chip48",
+	[PROFILE_SCHIP]		= "schip",
+	[PROFILE_XOCHIP]	= "xochip",
+};
+
+// FNV-1a 64 hashes (see romlib_hash) of ROMs whose quirks are known.
+// Everything else goes through detection.
+static const struct {
+	uint64_t hash;
+	Profile profile;
+} known_roms[] = {
+	{ 0xe59fd57fa44ecb40ULL, PROFILE_VIP },		// 15PUZZLE
+	{ 0x29bcab9b664d212bULL, PROFILE_VIP },		// BLITZ (needs clipping)
+	{ 0xa8e9391ebb18df6fULL, PROFILE_VIP },		// KALEID
+	{ 0x25e96e1086ce43cbULL, PROFILE_VIP },		// MAZE
+	{ 0x0fd332d0bc68c9f2ULL, PROFILE_SCHIP },	// BLINKY
+	{ 0x19fa1edf40fad0afULL, PROFILE_SCHIP },	// BC_test.ch8
+	{ 0x02a5224426249679ULL, PROFILE_SCHIP },	// c8_test.c8
+	{ 0x3f58eb4fa83dcd98ULL, PROFILE_CHIP48 },	// HIDDEN (data like 5xy3)
+	{ 0x8e547ebb12c026b4ULL, PROFILE_CHIP48 },	// INVADERS
+	{ 0x43def5533f6d8d25ULL, PROFILE_CHIP48 },	// MERLIN (data like 5xy2)
+	{ 0x71cdb8b926f1b988ULL, PROFILE_CHIP48 },	// MISSILE (data like 5xy3)
+	{ 0xec7ca0de3e110327ULL, PROFILE_CHIP48 },	// SYZYGY
+	{ 0x3e2c2d43b296b74cULL, PROFILE_CHIP48 },	// TANK (data like 00FF)
+	{ 0xcdaa32787deaa913ULL, PROFILE_CHIP48 },	// VBRIX
+};
+
+// Returns the profile called name, or -1
+int profile_from_name(const char *name)
+{
+	for(int p = 0; p < PROFILE_COUNT; p++){
+		if(strcmp(profile_names[p], name) == 0){
+			return p;
+		}
+	}
+	return -1;
+}
+
+// Marks the instructions reachable from 0x200, following jumps, calls,
+// skips and Bnnn (taken as if V0 was 0), like c8rec discovers code. Only
+// those are looked at, data bytes often look like extension opcodes.
+static void reachable(const unsigned char *data, size_t size, bool *code)
+{
+	static unsigned short work[MEMORY_SIZE];
+	int top = 0;
+	memset(code, 0x0, size);
+	work[top++] = 0x200;
+	while(top > 0){
+		unsigned int addr = work[--top];
+		while(addr >= 0x200 && addr - 0x200 + 1 < size && !code[addr - 0x200]){
+			code[addr - 0x200] = true;
+			unsigned short opcode = data[addr - 0x200] << 8 |
+				data[addr - 0x200 + 1];
+			unsigned int next = addr + (opcode == 0xF000 ? 4 : 2);
+			switch(opcode >> 12){
+				case 0x0:
+					if(opcode == 0x00EE || opcode == 0x00FD ||
+							(opcode != 0x00E0 && (opcode & 0xFF00) != 0x0000)){
+						// Returns, exits and machine code
+						next = 0;
+					}
+					break;
+				case 0x1:
+				case 0xB:
+					next = opcode & 0xFFF;
+					break;
+				case 0x2:
+					work[top++] = opcode & 0xFFF;
+					break;
+				case 0x3:
+				case 0x4:
+				case 0x5:
+				case 0x9:
+				case 0xE:
+					work[top++] = next + 2;
+					break;
+			}
+			addr = next;
+		}
+	}
+}
+
+// Looks for opcodes that only exist in SUPER-CHIP
+static bool uses_schip(const unsigned char *data, size_t size,
+		const bool *code)
+{
+	for(size_t i = 0; i + 1 < size; i++){
+		if(!code[i]){
+			continue;
+		}
+		unsigned short opcode = data[i] << 8 | data[i + 1];
+		switch(opcode & 0xF0FF){
+			case 0xF030:
+			case 0xF075:
+			case 0xF085:
+				return true;
+		}
+		if(opcode == 0x00FE || opcode == 0x00FF || opcode == 0x00FB ||
+				opcode == 0x00FC || opcode == 0x00FD ||
+				(opcode & 0xFFF0) == 0x00C0){
+			return true;
+		}
+	}
+	return false;
+}
+
+// Same as uses_schip for the XO-CHIP only opcodes. ROMs that don't fit in
+// the original 4 KB can only be XO-CHIP.
+static bool uses_xochip(const unsigned char *data, size_t size,
+		const bool *code)
+{
+	if(size > 4096 - 0x200){
+		return true;
+	}
+	for(size_t i = 0; i + 1 < size; i++){
+		if(!code[i]){
+			continue;
+		}
+		unsigned short opcode = data[i] << 8 | data[i + 1];
+		if(opcode == 0xF000 || opcode == 0xF002 ||
+				(opcode & 0xF0FF) == 0xF001 || (opcode & 0xF0FF) == 0xF03A ||
+				(opcode & 0xF00F) == 0x5002 || (opcode & 0xF00F) == 0x5003 ||
+				(opcode & 0xFFF0) == 0x00D0){
+			return true;
+		}
+	}
+	return false;
+}
+
+Profile profile_for_rom(uint64_t hash, const unsigned char *data, size_t size)
+{
+	for(size_t i = 0; i < sizeof(known_roms) / sizeof(known_roms[0]); i++){
+		if(known_roms[i].hash == hash){
+			return known_roms[i].profile;
+		}
+	}
+	static bool code[MEMORY_SIZE];
+	reachable(data, size, code);
+	// Most ROM packs in circulation were written for (or fixed up on) the
+	// HP-48 interpreters
+	if(uses_xochip(data, size, code)){
+		return PROFILE_XOCHIP;
+	}
+	return uses_schip(data, size, code) ? PROFILE_SCHIP : PROFILE_CHIP48;
+}
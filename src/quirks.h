@@ -0,0 +1,31 @@
+#ifndef QUIRKS_H
+#define QUIRKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Quirk profiles. Every profile is compiled into its own interpreter variant
+// (see interp.h), so picking one costs nothing once the game is running.
+//
+//                       8xy6/8xyE  Fx55/Fx65  Bnnn      Dxyn     8xy1/2/3
+//   PROFILE_VIP         VX = VY>>1 I += X+1   V0 + NNN  clip     VF = 0
+//   PROFILE_CHIP48      VX >>= 1   I += X     VX + XNN  wrap     VF kept
+//   PROFILE_SCHIP       VX >>= 1   I kept     VX + XNN  clip     VF kept
+//   PROFILE_XOCHIP      VX = VY>>1 I += X+1   V0 + NNN  wrap     VF kept
+//
+// SUPER-CHIP instructions are available in PROFILE_SCHIP and PROFILE_XOCHIP,
+// XO-CHIP instructions only in PROFILE_XOCHIP.
+typedef enum {
+	PROFILE_VIP,			// original COSMAC VIP interpreter
+	PROFILE_CHIP48,			// CHIP-48 (HP-48)
+	PROFILE_SCHIP,			// SUPER-CHIP 1.1
+	PROFILE_XOCHIP,			// XO-CHIP
+	PROFILE_COUNT
+} Profile;
+
+extern const char *profile_names[PROFILE_COUNT];
+
+int profile_from_name(const char *name);
+Profile profile_for_rom(uint64_t hash, const unsigned char *data, size_t size);
+
+#endif
@@ -0,0 +1,276 @@
+// Text renderers: one shade glyph per pixel, half blocks (1x2 pixels per
+// cell) and braille patterns (2x4 pixels per cell). The frame is written to
+// the terminal directly, next to ncurses, so the cursor is saved and
+// restored around it.
+//
+// Every cell is reduced to a glyph code (0 is always a blank cell) and
+// compared with what is already on the terminal. Unchanged cells are
+// skipped with cursor moves, runs of blanks are erased with ECH (or EL at
+// the end of a row) instead of being written out.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include "render.h"
+
+const char *render_names[RENDER_COUNT] = {
+	[RENDER_CURSES]		= "curses",
+	[RENDER_ANSI]		= "ansi",
+	[RENDER_HALF]		= "half",
+	[RENDER_BRAILLE]	= "braille",
+};
+
+// Half blocks indexed by (bottom << 1 | top)
+static const char *half_blocks[4] = { " ", "▀", "▄", "█" };
+
+// Shortest blank run worth an erase sequence instead of spaces
+#define MIN_ERASE_RUN 6
+
+// Braille dot of each pixel of a 2x4 cell, indexed by [y][x]
+static const unsigned char braille_dots[4][2] = {
+	{ 0x01, 0x08 },
+	{ 0x02, 0x10 },
+	{ 0x04, 0x20 },
+	{ 0x40, 0x80 },
+};
+
+// Returns the renderer called name, or -1
+int render_from_name(const char *name)
+{
+	for(int m = 0; m < RENDER_COUNT; m++){
+		if(strcmp(render_names[m], name) == 0){
+			return m;
+		}
+	}
+	return -1;
+}
+
+// Size in terminal cells of a width x height screen
+void render_cells(RenderMode mode, int width, int height, int *cols,
+		int *rows)
+{
+	switch(mode){
+		case RENDER_HALF:
+			*cols = width;
+			*rows = (height + 1) / 2;
+			break;
+		case RENDER_BRAILLE:
+			*cols = (width + 1) / 2;
+			*rows = (height + 3) / 4;
+			break;
+		default:
+			*cols = width;
+			*rows = height;
+	}
+}
+
+Renderer *new_renderer(RenderMode mode)
+{
+	Renderer *r = calloc(1, sizeof(Renderer));
+	assert(r != NULL);
+	r->mode = mode;
+
+	// Largest frame: 128x64 pixels where every other cell changed (a 3
+	// bytes glyph and a cursor move per 2 cells), a cursor move per row,
+	// plus the erase and the cursor save/restore
+	int cols, rows;
+	render_cells(mode, 128, GFX_ROWS, &cols, &rows);
+	r->capacity = rows * (cols * 4 + 16) + 64;
+	r->buf = malloc(r->capacity);
+	assert(r->buf != NULL);
+	r->cells = calloc(cols * rows, 1);
+	assert(r->cells != NULL);
+	r->clear = true;
+	return r;
+}
+
+void free_renderer(Renderer *r)
+{
+	if(r == NULL){
+		return;
+	}
+	free(r->buf);
+	free(r->cells);
+	free(r);
+}
+
+// Moves the game area. The old area is erased on the next frame.
+void renderer_place(Renderer *r, int top, int left, int cols, int rows)
+{
+	r->top = top;
+	r->left = left;
+	r->cols = cols;
+	r->rows = rows;
+	r->clear = true;
+}
+
+// Returns whether the pixel at x, y is lit (any plane)
+static inline int lit(const CPU *cpu, int x, int y)
+{
+	int bit = 63 - (x & 63);
+	return ((cpu->gfx[0][y][x >> 6] | cpu->gfx[1][y][x >> 6]) >> bit) & 1;
+}
+
+// Glyph code of a cell: pixel for ansi, bottom << 1 | top for half blocks,
+// dots for braille
+static unsigned char cell_code(RenderMode mode, const CPU *cpu, int col,
+		int row, int height)
+{
+	switch(mode){
+		case RENDER_HALF:
+			{
+			int y = row * 2;
+			unsigned char cell = lit(cpu, col, y);
+			if(y + 1 < height){
+				cell |= lit(cpu, col, y + 1) << 1;
+			}
+			return cell;
+			}
+		case RENDER_BRAILLE:
+			{
+			unsigned char dots = 0;
+			for(int dy = 0; dy < 4 && row * 4 + dy < height; dy++){
+				for(int dx = 0; dx < 2; dx++){
+					if(lit(cpu, col * 2 + dx, row * 4 + dy)){
+						dots |= braille_dots[dy][dx];
+					}
+				}
+			}
+			return dots;
+			}
+		default:
+			return lit(cpu, col, row);
+	}
+}
+
+// Writes the glyph of a (non blank) cell code, returns its length
+static int put_glyph(RenderMode mode, unsigned char code, char *p)
+{
+	switch(mode){
+		case RENDER_HALF:
+			memcpy(p, half_blocks[code], 3);
+			return 3;
+		case RENDER_BRAILLE:
+			// UTF-8 encoding of U+2800 + dots
+			p[0] = 0xE2;
+			p[1] = 0xA0 | code >> 6;
+			p[2] = 0x80 | (code & 0x3F);
+			return 3;
+		default:
+			memcpy(p, "▒", 3);
+			return 3;
+	}
+}
+
+// Builds the frame from the cells that changed and writes it out. Returns
+// the number of bytes written (0 when nothing changed).
+size_t renderer_draw(Renderer *r, const CPU *cpu, bool inverted)
+{
+	int width = SCREEN_WIDTH(cpu);
+	int height = SCREEN_HEIGHT(cpu);
+	int cols, rows;
+	render_cells(r->mode, width, height, &cols, &rows);
+	if(cols > r->cols){
+		cols = r->cols;
+	}
+	if(rows > r->rows){
+		rows = r->rows;
+	}
+	unsigned char invert = 0;
+	if(inverted){
+		invert = r->mode == RENDER_BRAILLE ? 0xFF :
+			r->mode == RENDER_HALF ? 0x3 : 0x1;
+	}
+
+	char *p = r->buf;
+	// Save cursor
+	p += sprintf(p, "\0337");
+	if(r->clear){
+		// Erase everything below the top of the game area, every cell is
+		// blank from now on
+		p += sprintf(p, "\033[%d;1H\033[J", r->top);
+		memset(r->cells, 0x0, r->cols * r->rows);
+		r->clear = false;
+	}
+	char *start = p;
+
+	for(int row = 0; row < rows; row++){
+		unsigned char *cells = &r->cells[row * r->cols];
+		unsigned char line[128];
+		for(int col = 0; col < cols; col++){
+			line[col] = cell_code(r->mode, cpu, col, row, height) ^ invert;
+		}
+
+		// Column of the cursor on this row, -1 if elsewhere
+		int cursor = -1;
+		int col = 0;
+		while(col < cols){
+			if(line[col] == cells[col]){
+				col++;
+				continue;
+			}
+
+			// Get the cursor to the first changed cell
+			if(cursor < 0){
+				p += sprintf(p, "\033[%d;%dH", r->top + row, r->left + col);
+			} else if(cursor != col){
+				p += sprintf(p, "\033[%dC", col - cursor);
+			}
+
+			if(line[col] == 0){
+				// Blank run, unchanged blanks included
+				int run = 0;
+				while(col + run < cols && line[col + run] == 0){
+					run++;
+				}
+				if(col + run == cols){
+					// Erase to the end of the row (nothing lives on the
+					// right of the game area)
+					p += sprintf(p, "\033[K");
+					memset(&cells[col], 0x0, run);
+					col += run;
+					cursor = -1;
+					continue;
+				}
+				if(run >= MIN_ERASE_RUN){
+					// ECH doesn't move the cursor
+					p += sprintf(p, "\033[%dX", run);
+					memset(&cells[col], 0x0, run);
+					col += run;
+					cursor = col - run;
+					continue;
+				}
+				*p++ = ' ';
+			} else {
+				p += put_glyph(r->mode, line[col], p);
+			}
+			cells[col] = line[col];
+			col++;
+			cursor = col;
+		}
+	}
+
+	if(p == start){
+		// Nothing changed
+		r->size = 0;
+		return 0;
+	}
+	// Restore cursor
+	p += sprintf(p, "\0338");
+
+	r->size = p - r->buf;
+	assert(r->size <= r->capacity);
+
+	// One write per frame; retry on short writes so the frame never tears
+	size_t done = 0;
+	while(done < r->size){
+		ssize_t n = write(STDOUT_FILENO, r->buf + done, r->size - done);
+		if(n <= 0){
+			break;
+		}
+		done += n;
+	}
+	return r->size;
+}
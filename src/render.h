@@ -0,0 +1,50 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cpu.h"
+
+// Game window backends. RENDER_CURSES draws one cell per pixel through
+// ncurses, the others write ANSI escape sequences to the terminal directly.
+typedef enum {
+	RENDER_CURSES,			// 1x1 pixels per cell (ACS characters)
+	RENDER_ANSI,			// 1x1 pixels per cell (shade glyph)
+	RENDER_HALF,			// 1x2 pixels per cell (half blocks)
+	RENDER_BRAILLE,			// 2x4 pixels per cell (braille patterns)
+	RENDER_COUNT
+} RenderMode;
+
+extern const char *render_names[RENDER_COUNT];
+
+// Text renderers build the whole frame in a buffer allocated once for the
+// largest screen, then hand it to the terminal with a single write(). Only
+// the cells that changed since the previous frame are sent.
+typedef struct {
+	RenderMode mode;
+	int top, left;					// terminal position of the game (1-based)
+	int cols, rows;					// size of the game in cells
+	char *buf;						// frame output
+	size_t capacity;				// size of buf
+	size_t size;					// bytes of the last frame
+	bool clear;						// erase the old area before drawing
+	unsigned char *cells;			// cells on the terminal (glyph codes)
+} Renderer;
+
+// Bytes and time spent per presented frame, for comparing backends
+typedef struct {
+	unsigned long frames;			// frames drawn
+	unsigned long bytes;			// bytes sent to the terminal
+	unsigned long build_ns;			// time spent building the frames
+} RenderStats;
+
+int render_from_name(const char *name);
+void render_cells(RenderMode mode, int width, int height, int *cols,
+		int *rows);
+Renderer *new_renderer(RenderMode mode);
+void free_renderer(Renderer *r);
+void renderer_place(Renderer *r, int top, int left, int cols, int rows);
+size_t renderer_draw(Renderer *r, const CPU *cpu, bool inverted);
+
+#endif
@@ -0,0 +1,304 @@
+// ROM library: mmaps every ROM of a directory, keeps a persistent index of
+// them (name, size, content hash, detected quirk profile) and lets the user
+// pick one through an ncurses menu.
+#include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#include "romlib.h"
+#include "quirks.h"
+
+// Largest ROM that fits in memory after the 0x200 interpreter area (XO-CHIP)
+#define ROMLIB_MAX_SIZE (0x10000 - 0x200)
+
+static int compare_roms(const void *a, const void *b)
+{
+	return strcmp(((const ROM *)a)->name, ((const ROM *)b)->name);
+}
+
+// Documentation files live next to the test ROMs, skip them
+static bool is_rom_name(const char *name)
+{
+	if(name[0] == '.'){
+		return false;
+	}
+	const char *ext = strrchr(name, '.');
+	if(ext != NULL && (strcmp(ext, ".txt") == 0 || strcmp(ext, ".md") == 0)){
+		return false;
+	}
+	return true;
+}
+
+uint64_t romlib_hash(const unsigned char *data, size_t size)
+{
+	// FNV-1a 64 bits
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for(size_t i = 0; i < size; i++){
+		h ^= data[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+// Reads the cached index of a directory. Entries are only reused when both
+// the size and the modification time of the file still match. One ROM per
+// line, its name last so that it may hold spaces.
+static void load_index(ROMLibrary *lib)
+{
+	char path[4200];
+	snprintf(path, sizeof(path), "%s/%s", lib->dir, ROMLIB_INDEX);
+	FILE *f = fopen(path, "r");
+	if(f == NULL){
+		return;
+	}
+
+	// Indexes written by another version may hold stale profiles
+	char line[256];
+	int version;
+	if(fgets(line, sizeof(line), f) == NULL ||
+			sscanf(line, "# yac8e-index %d", &version) != 1 ||
+			version != ROMLIB_INDEX_VERSION){
+		fclose(f);
+		return;
+	}
+
+	char profile[16];
+	size_t size;
+	long long mtime;
+	uint64_t hash;
+	int name_at;
+	while(fgets(line, sizeof(line), f) != NULL){
+		if(sscanf(line, "%zu %lld %" SCNx64 " %15s %n", &size, &mtime, &hash,
+					profile, &name_at) != 4){
+			continue;
+		}
+		char *name = line + name_at;
+		name[strcspn(name, "\n")] = '\0';
+		int i = romlib_find(lib, name);
+		if(i < 0 || profile_from_name(profile) < 0){
+			continue;
+		}
+		ROM *rom = &lib->roms[i];
+		if(rom->size == size && rom->mtime == (time_t)mtime){
+			rom->hash = hash;
+			snprintf(rom->profile, sizeof(rom->profile), "%s", profile);
+		}
+	}
+	fclose(f);
+}
+
+static void save_index(ROMLibrary *lib)
+{
+	char path[4200];
+	snprintf(path, sizeof(path), "%s/%s", lib->dir, ROMLIB_INDEX);
+	FILE *f = fopen(path, "w");
+	if(f == NULL){
+		// Read-only ROM directory, the index will be rebuilt next time
+		return;
+	}
+	fprintf(f, "# yac8e-index %d\n", ROMLIB_INDEX_VERSION);
+	for(int i = 0; i < lib->count; i++){
+		ROM *rom = &lib->roms[i];
+		fprintf(f, "%zu %lld %016" PRIx64 " %s %s\n", rom->size,
+				(long long)rom->mtime, rom->hash, rom->profile, rom->name);
+	}
+	fclose(f);
+}
+
+// mmaps every ROM in a directory and builds (or refreshes) its index. The
+// index is only written back with save: a ROM opened on its own may sit in
+// a directory that isn't ours to write to.
+ROMLibrary *romlib_open(const char *dir, bool save)
+{
+	DIR *d = opendir(dir);
+	if(d == NULL){
+		return NULL;
+	}
+
+	ROMLibrary *lib = calloc(1, sizeof(ROMLibrary));
+	assert(lib != NULL);
+	snprintf(lib->dir, sizeof(lib->dir), "%s", dir);
+
+	int capacity = 0;
+	struct dirent *entry;
+	while((entry = readdir(d)) != NULL){
+		if(!is_rom_name(entry->d_name) ||
+				strlen(entry->d_name) >= sizeof(lib->roms->name)){
+			continue;
+		}
+
+		char path[4200];
+		snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+		int fd = open(path, O_RDONLY);
+		if(fd < 0){
+			continue;
+		}
+		struct stat st;
+		if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+				st.st_size > ROMLIB_MAX_SIZE){
+			close(fd);
+			continue;
+		}
+		void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if(data == MAP_FAILED){
+			continue;
+		}
+
+		if(lib->count == capacity){
+			capacity = capacity ? capacity * 2 : 32;
+			lib->roms = realloc(lib->roms, capacity * sizeof(ROM));
+			assert(lib->roms != NULL);
+		}
+		ROM *rom = &lib->roms[lib->count++];
+		memset(rom, 0, sizeof(ROM));
+		memcpy(rom->name, entry->d_name, strlen(entry->d_name) + 1);
+		rom->data = data;
+		rom->size = st.st_size;
+		rom->mtime = st.st_mtime;
+	}
+	closedir(d);
+
+	qsort(lib->roms, lib->count, sizeof(ROM), compare_roms);
+
+	// Only hash and inspect the ROMs the index doesn't know about
+	load_index(lib);
+	bool dirty = false;
+	for(int i = 0; i < lib->count; i++){
+		ROM *rom = &lib->roms[i];
+		if(rom->profile[0] == '\0'){
+			rom->hash = romlib_hash(rom->data, rom->size);
+			Profile p = profile_for_rom(rom->hash, rom->data, rom->size);
+			snprintf(rom->profile, sizeof(rom->profile), "%s",
+					profile_names[p]);
+			dirty = true;
+		}
+	}
+	if(dirty && save){
+		save_index(lib);
+	}
+
+	return lib;
+}
+
+void romlib_close(ROMLibrary *lib)
+{
+	if(lib == NULL){
+		return;
+	}
+	for(int i = 0; i < lib->count; i++){
+		munmap((void *)lib->roms[i].data, lib->roms[i].size);
+	}
+	free(lib->roms);
+	free(lib);
+}
+
+// Returns the index of the ROM called name, or -1
+int romlib_find(ROMLibrary *lib, const char *name)
+{
+	ROM key;
+	snprintf(key.name, sizeof(key.name), "%s", name);
+	ROM *rom = bsearch(&key, lib->roms, lib->count, sizeof(ROM), compare_roms);
+	if(rom == NULL){
+		return -1;
+	}
+	return rom - lib->roms;
+}
+
+// Shows the game selection menu. Returns the index of the chosen ROM, or -1
+// if the menu was cancelled or doesn't fit in the terminal.
+int romlib_pick(ROMLibrary *lib, int current)
+{
+	if(lib->count == 0){
+		return -1;
+	}
+	if(LINES < ROMLIB_MENU_LINES){
+		beep();
+		return -1;
+	}
+
+	int height = LINES - 4;
+	int width = 60;
+	if(height > lib->count + 4){
+		height = lib->count + 4;
+	}
+	if(width > COLS){
+		width = COLS;
+	}
+	WINDOW *menu_w = newwin(height, width, (LINES - height) / 2,
+			(COLS - width) / 2);
+	if(menu_w == NULL){
+		return -1;
+	}
+	keypad(menu_w, TRUE);
+
+	int rows = height - 4;
+	int selected = current >= 0 ? current : 0;
+	int top = 0;
+	int chosen = -1;
+	bool done = false;
+	while(!done){
+		if(selected < top){
+			top = selected;
+		} else if(selected >= top + rows){
+			top = selected - rows + 1;
+		}
+
+		werase(menu_w);
+		box(menu_w, 0, 0);
+		mvwprintw(menu_w, 0, 2, " %s (%d ROMs) ", lib->dir, lib->count);
+		mvwprintw(menu_w, 1, 2, "%-24s %6s %-16s %s", "Name", "Size", "Hash",
+				"Profile");
+		for(int r = 0; r < rows && top + r < lib->count; r++){
+			ROM *rom = &lib->roms[top + r];
+			if(top + r == selected){
+				wattron(menu_w, A_REVERSE);
+			}
+			mvwprintw(menu_w, r + 2, 2, "%-24s %6zu %016" PRIx64 " %s",
+					rom->name, rom->size, rom->hash, rom->profile);
+			wattroff(menu_w, A_REVERSE);
+		}
+		mvwprintw(menu_w, height - 1, 2,
+				" Up/Down: select - Enter: play - Esc: back ");
+		wrefresh(menu_w);
+
+		switch(wgetch(menu_w)){
+			case KEY_UP:
+				if(selected > 0) selected--;
+				break;
+			case KEY_DOWN:
+				if(selected < lib->count - 1) selected++;
+				break;
+			case KEY_PPAGE:
+				selected = selected > rows ? selected - rows : 0;
+				break;
+			case KEY_NPAGE:
+				selected += rows;
+				if(selected >= lib->count) selected = lib->count - 1;
+				break;
+			case '\n':
+			case KEY_ENTER:
+				chosen = selected;
+				done = true;
+				break;
+			case 27:	// Esc
+			case KEY_F(2):
+				done = true;
+				break;
+		}
+	}
+
+	delwin(menu_w);
+	// Repaint whatever was under the menu
+	touchwin(stdscr);
+	wnoutrefresh(stdscr);
+	return chosen;
+}
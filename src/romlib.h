@@ -0,0 +1,38 @@
+#ifndef ROMLIB_H
+#define ROMLIB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Name of the index file cached inside every ROM directory
+#define ROMLIB_INDEX ".yac8e-index"
+#define ROMLIB_INDEX_VERSION 5
+// Terminal lines the game selection menu needs to show one ROM
+#define ROMLIB_MENU_LINES 9
+
+// A single ROM of the library. The contents stay mmap'd for the lifetime of
+// the library so switching games never goes back to the disk.
+typedef struct {
+	char name[64];					// file name (no directory)
+	const unsigned char *data;		// mmap'd ROM contents
+	size_t size;					// size in bytes
+	time_t mtime;					// last modification (index validation)
+	uint64_t hash;					// FNV-1a 64 content hash
+	char profile[16];				// quirk profile (see quirks.h)
+} ROM;
+
+typedef struct {
+	char dir[4096];					// directory the library was built from
+	ROM *roms;						// ROMs sorted by name
+	int count;						// number of ROMs
+} ROMLibrary;
+
+ROMLibrary *romlib_open(const char *dir, bool save);
+void romlib_close(ROMLibrary *lib);
+int romlib_find(ROMLibrary *lib, const char *name);
+int romlib_pick(ROMLibrary *lib, int current);
+uint64_t romlib_hash(const unsigned char *data, size_t size);
+
+#endif
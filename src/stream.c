@@ -0,0 +1,312 @@
+// Spectator streaming (see stream.h). Publishing never blocks the emulation:
+// every socket is non-blocking, and a viewer that can't keep up simply
+// misses frames.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "stream.h"
+
+// Fills in the socket address for addr: a UNIX socket path or a TCP port on
+// localhost. Returns the size of the address, or 0.
+static socklen_t parse_addr(const char *addr, struct sockaddr_storage *ss)
+{
+	memset(ss, 0x0, sizeof(*ss));
+	if(strchr(addr, '/') != NULL){
+		struct sockaddr_un *un = (struct sockaddr_un *)ss;
+		if(strlen(addr) >= sizeof(un->sun_path)){
+			return 0;
+		}
+		un->sun_family = AF_UNIX;
+		strcpy(un->sun_path, addr);
+		return sizeof(*un);
+	}
+	int port = atoi(addr);
+	if(port <= 0 || port > 0xFFFF){
+		return 0;
+	}
+	struct sockaddr_in *in = (struct sockaddr_in *)ss;
+	in->sin_family = AF_INET;
+	in->sin_port = htons(port);
+	in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	return sizeof(*in);
+}
+
+// Starts listening on addr. Returns NULL (errno set) on failure.
+Stream *stream_open(const char *addr)
+{
+	struct sockaddr_storage ss;
+	socklen_t len = parse_addr(addr, &ss);
+	if(len == 0){
+		errno = EINVAL;
+		return NULL;
+	}
+
+	int fd = socket(ss.ss_family, SOCK_STREAM, 0);
+	if(fd < 0){
+		return NULL;
+	}
+	int one = 1;
+	if(ss.ss_family == AF_UNIX){
+		// Left over by an instance that didn't exit cleanly
+		unlink(addr);
+	} else {
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	}
+	if(bind(fd, (struct sockaddr *)&ss, len) < 0 ||
+			listen(fd, STREAM_MAX_VIEWERS) < 0){
+		close(fd);
+		return NULL;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	Stream *s = calloc(1, sizeof(Stream));
+	assert(s != NULL);
+	s->fd = fd;
+	if(ss.ss_family == AF_UNIX){
+		snprintf(s->path, sizeof(s->path), "%s", addr);
+	}
+	return s;
+}
+
+void stream_close(Stream *s)
+{
+	if(s == NULL){
+		return;
+	}
+	for(int i = 0; i < s->count; i++){
+		close(s->viewers[i].fd);
+	}
+	close(s->fd);
+	if(s->path[0] != '\0'){
+		unlink(s->path);
+	}
+	free(s);
+}
+
+// Connects a viewer to addr. Returns the socket, or -1 (errno set).
+int stream_connect(const char *addr)
+{
+	struct sockaddr_storage ss;
+	socklen_t len = parse_addr(addr, &ss);
+	if(len == 0){
+		errno = EINVAL;
+		return -1;
+	}
+	int fd = socket(ss.ss_family, SOCK_STREAM, 0);
+	if(fd < 0){
+		return -1;
+	}
+	if(connect(fd, (struct sockaddr *)&ss, len) < 0){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Serializes the frame buffer (every plane, row and word, big endian)
+void stream_frame(const CPU *cpu, unsigned char *frame)
+{
+	for(int p = 0; p < GFX_PLANES; p++){
+		for(int y = 0; y < GFX_ROWS; y++){
+			for(int w = 0; w < 2; w++){
+				uint64_t word = cpu->gfx[p][y][w];
+				for(int b = 0; b < 8; b++){
+					*frame++ = word >> (56 - b * 8);
+				}
+			}
+		}
+	}
+}
+
+// Opposite of stream_frame
+void stream_load(CPU *cpu, const unsigned char *frame)
+{
+	for(int p = 0; p < GFX_PLANES; p++){
+		for(int y = 0; y < GFX_ROWS; y++){
+			for(int w = 0; w < 2; w++){
+				uint64_t word = 0;
+				for(int b = 0; b < 8; b++){
+					word = word << 8 | *frame++;
+				}
+				cpu->gfx[p][y][w] = word;
+			}
+		}
+	}
+}
+
+// Writes a message with frame XORed against ref (a blank screen if NULL)
+// and run-length encoded. Single zero bytes go with the literals, which
+// keeps the payload under STREAM_FRAME_SIZE plus one byte per 128.
+size_t stream_encode(unsigned char *msg, char type, bool hires,
+		const unsigned char *frame, const unsigned char *ref)
+{
+	unsigned char x[STREAM_FRAME_SIZE];
+	for(int i = 0; i < STREAM_FRAME_SIZE; i++){
+		x[i] = ref != NULL ? frame[i] ^ ref[i] : frame[i];
+	}
+
+	unsigned char *p = msg + 4;
+	int i = 0;
+	while(i < STREAM_FRAME_SIZE){
+		if(x[i] == 0 && i + 1 < STREAM_FRAME_SIZE && x[i + 1] == 0){
+			int run = 0;
+			while(i < STREAM_FRAME_SIZE && x[i] == 0 && run < 128){
+				i++;
+				run++;
+			}
+			*p++ = run - 1;
+		} else {
+			int start = i;
+			while(i < STREAM_FRAME_SIZE && i - start < 128 &&
+					!(x[i] == 0 && i + 1 < STREAM_FRAME_SIZE && x[i + 1] == 0)){
+				i++;
+			}
+			*p++ = 0x80 | (i - start - 1);
+			memcpy(p, &x[start], i - start);
+			p += i - start;
+		}
+	}
+
+	size_t size = p - msg - 4;
+	msg[0] = type;
+	msg[1] = hires ? STREAM_HIRES : 0;
+	msg[2] = size & 0xFF;
+	msg[3] = size >> 8;
+	return p - msg;
+}
+
+// XORs a payload into frame. Returns false if it is malformed.
+bool stream_decode(const unsigned char *payload, size_t size,
+		unsigned char *frame)
+{
+	size_t i = 0, o = 0;
+	while(i < size){
+		unsigned char c = payload[i++];
+		int n = (c & 0x7F) + 1;
+		if(o + n > STREAM_FRAME_SIZE){
+			return false;
+		}
+		if(c < 0x80){
+			o += n;
+			continue;
+		}
+		if(i + n > size){
+			return false;
+		}
+		for(int k = 0; k < n; k++){
+			frame[o++] ^= payload[i++];
+		}
+	}
+	return o == STREAM_FRAME_SIZE;
+}
+
+// Sends what the socket takes of the pending message. Returns false when
+// the viewer is gone.
+static bool flush(Viewer *v)
+{
+	while(v->sent < v->size){
+		ssize_t n = send(v->fd, v->pending + v->sent, v->size - v->sent,
+				MSG_NOSIGNAL | MSG_DONTWAIT);
+		if(n < 0){
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+		}
+		v->sent += n;
+	}
+	return true;
+}
+
+static void queue(Viewer *v, const unsigned char *msg, size_t size)
+{
+	memcpy(v->pending, msg, size);
+	v->size = size;
+	v->sent = 0;
+}
+
+// Accepts new viewers and sends them the screen: deltas to the viewers that
+// have the previous frame, keyframes to the ones that just connected or
+// dropped frames. changed tells whether gfx changed since the last call.
+// Calls closer than STREAM_INTERVAL_NS only take note of changes.
+void stream_publish(Stream *s, const CPU *cpu, bool changed)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	s->changed |= changed;
+	if((now.tv_sec - s->last.tv_sec) * 1000000000L +
+			(now.tv_nsec - s->last.tv_nsec) < STREAM_INTERVAL_NS){
+		return;
+	}
+	s->last = now;
+	changed = s->changed;
+	s->changed = false;
+
+	int fd;
+	while((fd = accept(s->fd, NULL, NULL)) >= 0){
+		if(s->count == STREAM_MAX_VIEWERS){
+			close(fd);
+			continue;
+		}
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		Viewer *v = &s->viewers[s->count++];
+		v->fd = fd;
+		v->synced = false;
+		v->size = v->sent = 0;
+	}
+	if(s->count == 0){
+		return;
+	}
+
+	static unsigned char frame[STREAM_FRAME_SIZE];
+	static unsigned char delta[STREAM_MAX_MESSAGE], key[STREAM_MAX_MESSAGE];
+	size_t delta_size = 0, key_size = 0;
+	stream_frame(cpu, frame);
+	if(changed){
+		delta_size = stream_encode(delta, 'D', cpu->hires, frame, s->frame);
+	}
+
+	for(int i = 0; i < s->count; i++){
+		Viewer *v = &s->viewers[i];
+		if(!flush(v)){
+			close(v->fd);
+			s->viewers[i--] = s->viewers[--s->count];
+			continue;
+		}
+		if(v->sent < v->size){
+			// Still busy with an older frame
+			if(changed){
+				v->synced = false;
+				s->dropped++;
+			}
+			continue;
+		}
+		if(v->synced){
+			if(!changed){
+				continue;
+			}
+			queue(v, delta, delta_size);
+		} else {
+			if(key_size == 0){
+				key_size = stream_encode(key, 'K', cpu->hires, frame, NULL);
+			}
+			queue(v, key, key_size);
+			v->synced = true;
+		}
+		if(!flush(v)){
+			close(v->fd);
+			s->viewers[i--] = s->viewers[--s->count];
+		}
+	}
+	memcpy(s->frame, frame, sizeof(frame));
+	s->hires = cpu->hires;
+}
@@ -0,0 +1,62 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "cpu.h"
+
+// Spectator streaming: frames are published on a UNIX domain socket (an
+// address containing a '/') or a localhost TCP port, to any number of
+// viewers (c8view).
+//
+// Every message is a 4 bytes header followed by the payload:
+//   type		'K' keyframe (against a blank screen) or 'D' delta (against the
+//				previous message)
+//   flags		STREAM_HIRES
+//   length		payload size, 16 bits little endian
+// The payload is the frame buffer (all of gfx as big endian bytes) XORed
+// with the reference frame and run-length encoded: a byte below 0x80 stands
+// for that many plus one zero bytes, otherwise (byte & 0x7F) + 1 literal
+// bytes follow.
+#define STREAM_FRAME_SIZE (GFX_PLANES * GFX_ROWS * 16)
+#define STREAM_MAX_MESSAGE (4 + STREAM_FRAME_SIZE + STREAM_FRAME_SIZE / 128)
+#define STREAM_MAX_VIEWERS 16
+#define STREAM_HIRES 0x1
+// Viewers get at most 60 frames per second of real time (turbo runs faster)
+#define STREAM_INTERVAL_NS (1000000000L / 60)
+
+// A connected viewer. A viewer that hasn't taken the whole previous message
+// yet misses frames, and gets a keyframe once it has caught up.
+typedef struct {
+	int fd;
+	bool synced;					// has the last frame, gets deltas
+	unsigned char pending[STREAM_MAX_MESSAGE];	// message being sent
+	size_t size, sent;
+} Viewer;
+
+typedef struct {
+	int fd;							// listening socket
+	char path[108];					// UNIX socket, removed on close
+	unsigned char frame[STREAM_FRAME_SIZE];	// last frame published
+	bool hires;
+	struct timespec last;			// time of the last publication
+	bool changed;					// gfx changed since then
+	Viewer viewers[STREAM_MAX_VIEWERS];
+	int count;						// connected viewers
+	unsigned long dropped;			// frames slow viewers missed
+} Stream;
+
+Stream *stream_open(const char *addr);
+void stream_close(Stream *s);
+void stream_publish(Stream *s, const CPU *cpu, bool changed);
+int stream_connect(const char *addr);
+void stream_frame(const CPU *cpu, unsigned char *frame);
+void stream_load(CPU *cpu, const unsigned char *frame);
+size_t stream_encode(unsigned char *msg, char type, bool hires,
+		const unsigned char *frame, const unsigned char *ref);
+bool stream_decode(const unsigned char *payload, size_t size,
+		unsigned char *frame);
+
+#endif
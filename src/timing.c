@@ -0,0 +1,77 @@
+// COSMAC VIP instruction timing (see timing.h)
+#include "timing.h"
+
+// Fetching and decoding an instruction, and jumping to its routine
+#define FETCH 40
+
+uint16_t vip_cycles[0x10000];
+
+// Cycles of an instruction, after the VIP interpreter's routines
+static unsigned int cost(unsigned short opcode)
+{
+	int x = opcode >> 8 & 0xF, n = opcode & 0xF;
+	switch(opcode >> 12){
+		case 0x0:
+			if(opcode == 0x00E0){
+				// 256 bytes of display memory, 12 cycles each
+				return FETCH + 3078;
+			}
+			if(opcode == 0x00EE){
+				return FETCH + 10;
+			}
+			// Machine code subroutine, not emulated
+			return FETCH + 10;
+		case 0x1:
+			return FETCH + 12;
+		case 0x2:
+			return FETCH + 26;
+		case 0x3:
+		case 0x4:
+			return FETCH + 10;
+		case 0x5:
+		case 0x9:
+			return FETCH + 14;
+		case 0x6:
+			return FETCH + 6;
+		case 0x7:
+			return FETCH + 10;
+		case 0x8:
+			// The VIP builds the 1802 instruction in memory and runs it
+			return FETCH + 44;
+		case 0xA:
+			return FETCH + 12;
+		case 0xB:
+			return FETCH + 22;
+		case 0xC:
+			return FETCH + 36;
+		case 0xD:
+			// Each row is shifted into place and XORed into two bytes
+			return FETCH + 68 + 46 * n;
+		case 0xE:
+			return FETCH + 18;
+		case 0xF:
+			switch(opcode & 0xFF){
+				case 0x1E:
+					return FETCH + 16;
+				case 0x29:
+					return FETCH + 20;
+				case 0x33:
+					// Repeated subtractions, for an average number
+					return FETCH + 180;
+				case 0x55:
+				case 0x65:
+					return FETCH + 14 * (x + 1);
+				default:
+					return FETCH + 10;
+			}
+	}
+	return FETCH;
+}
+
+// Fills the table, once before the first VIP frame
+void timing_init()
+{
+	for(int opcode = 0; opcode < 0x10000; opcode++){
+		vip_cycles[opcode] = cost(opcode);
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+
+#include "cpu.h"
+
+// Timing of the original COSMAC VIP (-c vip). Instead of a fixed number of
+// instructions per 60 Hz frame, every instruction costs what the VIP
+// interpreter took to run it, in 1802 machine cycles of 8 clocks of the
+// 1.76 MHz crystal. A frame of the 1861 is 262 lines of 14 machine cycles,
+// 3668 in all. Of these, the display DMA takes 1024: 128 lines (the 32 rows
+// shown 4 times each) of 8 bytes, a machine cycle per byte. The interrupt
+// routine that sets it up and counts down the timers takes 112 more. The
+// 2532 that are left are the budget of a frame.
+//
+// Dxyn waits for the display: the VIP draws sprites during the vertical
+// blank, so a frame ends with its first Dxyn and the drawing time is taken
+// from the next one. Costs are approximate (some depend on data, like the
+// digits of Fx33), a table lookup and an add per instruction.
+#define VIP_FRAME_CYCLES 3668
+#define VIP_DISPLAY_CYCLES 1024
+#define VIP_INTERRUPT_CYCLES 112
+#define VIP_BUDGET (VIP_FRAME_CYCLES - VIP_DISPLAY_CYCLES - VIP_INTERRUPT_CYCLES)
+
+// Cycles of every opcode, filled by timing_init()
+extern uint16_t vip_cycles[0x10000];
+
+void timing_init();
+
+// Whether an opcode waits for the display
+static inline int vip_waits(unsigned short opcode)
+{
+	return (opcode & 0xF000) == 0xD000;
+}
+
+#endif
@@ -0,0 +1,109 @@
+// yac8e-stat - prints the live metrics of an emulator started with `yac8e -m`
+//
+//   yac8e-stat [-i seconds] [pid]
+//
+// Without a pid, the first running emulator found is picked. -i prints the
+// metrics again every that many seconds, until the emulator exits.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "metrics.h"
+
+static bool running(pid_t pid)
+{
+	return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+// Pid of a running emulator publishing metrics, or 0
+static pid_t find_emulator()
+{
+	DIR *dir = opendir("/dev/shm");
+	if(dir == NULL){
+		return 0;
+	}
+	pid_t pid = 0;
+	struct dirent *entry;
+	while(pid == 0 && (entry = readdir(dir)) != NULL){
+		if(strncmp(entry->d_name, METRICS_PREFIX, strlen(METRICS_PREFIX)) != 0){
+			continue;
+		}
+		pid_t p = atoi(entry->d_name + strlen(METRICS_PREFIX));
+		// Segments of emulators that crashed stay behind
+		if(p > 0 && running(p)){
+			pid = p;
+		}
+	}
+	closedir(dir);
+	return pid;
+}
+
+static void print_metrics(const Metrics *m)
+{
+	printf("yac8e %d - %s\n", (int)m->pid, m->rom);
+	printf("Instructions: %lu (%lu per second), clock %u ipf%s\n",
+			(unsigned long)m->instructions, (unsigned long)m->ips, m->ipf,
+			m->turbo ? " turbo" : "");
+	printf("Frames: %lu emulated (%lu per second), %lu presented\n",
+			(unsigned long)m->frames, (unsigned long)m->frame_rate,
+			(unsigned long)m->presented);
+	printf("Frame time: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, "
+			"p99.9 %.3f ms\n",
+			metrics_percentile(m, 0.5) / 1e6, metrics_percentile(m, 0.9) / 1e6,
+			metrics_percentile(m, 0.99) / 1e6,
+			metrics_percentile(m, 0.999) / 1e6);
+	double total = m->emulate_ns + m->draw_ns;
+	printf("Time: %.2f s emulating, %.2f s drawing (%.0f%%)\n",
+			m->emulate_ns / 1e9, m->draw_ns / 1e9,
+			total > 0 ? m->draw_ns * 100 / total : 0);
+	printf("Input: %lu key events, %u in the last frame (max %u)\n",
+			(unsigned long)m->keys, m->input_depth, m->input_max);
+	printf("Dropped: %lu late frames, %lu spectator frames, %lu audio "
+			"frames\n", (unsigned long)m->late,
+			(unsigned long)m->stream_dropped, (unsigned long)m->audio_dropped);
+}
+
+int main(int argc, char **argv)
+{
+	int interval = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "i:")) != -1){
+		switch(opt){
+			case 'i':
+				interval = atoi(optarg);
+				break;
+			default:
+				optind = argc + 1;
+		}
+	}
+	if(optind < argc - 1 || optind > argc || interval < 0){
+		printf("Usage: yac8e-stat {-i seconds} {pid}\n");
+		return 1;
+	}
+
+	pid_t pid = optind < argc ? atoi(argv[optind]) : find_emulator();
+	Metrics *m = pid > 0 ? metrics_attach(pid) : NULL;
+	if(m == NULL){
+		printf("No emulator publishing metrics (yac8e -m)\n");
+		return 1;
+	}
+
+	Metrics copy;
+	do {
+		if(!metrics_read(m, &copy)){
+			printf("Metrics keep changing, try again\n");
+			return 1;
+		}
+		print_metrics(&copy);
+		if(interval > 0){
+			printf("\n");
+			fflush(stdout);
+			sleep(interval);
+		}
+	} while(interval > 0 && running(pid));
+	return 0;
+}
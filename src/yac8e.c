@@ -1,8 +1,6 @@
 // TODOS
-// - Decouple timers from the clock rate
 // - Fix multithreading so that multiple keys don't block each other 
 // - (OPTIONAL) Reset command
-// - (OPTIONAL) Control refresh rate via command
 //
 #include <ncurses.h>
 #include <stdlib.h>
@@ -11,132 +9,381 @@
 #include <assert.h>
 #include <time.h>
 #include <pthread.h>
-
-// A struct representing the CPU. Will be separated later
-typedef struct { 
-	unsigned char memory[4096];		// memory
-	unsigned char V[16];			// registers
-	unsigned short stack[16];		// call stack
-	unsigned short gfx[64 * 32];	// frame buffer (64x32 pixels)
-	unsigned char input[16];		// keyboard inputs
-	unsigned short I;				// index registers
-	unsigned short pc;				// program counter
-	unsigned char delay_timer;		// delay timer
-	unsigned char sound_timer;		// sound timer
-	int sp;							// stack pointer
-	bool draw;						// draw flag
-	bool key_is_pressed;			// self explanatory
-} CPU;
+#include <libgen.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdatomic.h>
+
+#include "cpu.h"
+#include "romlib.h"
+#include "render.h"
+#include "native.h"
+#include "stream.h"
+#include "audio.h"
+#include "metrics.h"
+#include "gdb.h"
+#include "capture.h"
+#include "netplay.h"
+#include "timing.h"
 
 WINDOW *create_newwin(int width, int height, int starty, int startx);
 void initGraphics(int DEBUG);
-void initFonts();
-CPU *new_cpu();
 void createWindows();
+void createGameWindow(int width, int height);
 void tick(int DEBUG);
+void frame(int DEBUG);
+void run(int n, int DEBUG);
+int run_vip(int DEBUG);
+void timers(int DEBUG);
+void simulate(CPU *cpu);
+void pace();
+void record_frame(uint64_t start, uint64_t emulated);
 void draw();
+void drawCurses(int width, int height, int inverted);
 void end();
 void panic();
 void *updateKeys(void *cpu);
-bool push_stack(unsigned short value, CPU *cpu);
-unsigned short pop_stack(CPU *cpu);
+void press(int key);
+void load_rom(ROM *rom);
+unsigned long written_bytes();
 
 
 
 // Can I escape globals?
 CPU *chip8;
 WINDOW **windows;
+// Interpreter specialized for the quirk profile of the running ROM
+step_fn step;
+// Translation of the running ROM (make native), NULL if there's none or the
+// ROM wrote over its own code
+const NativeROM *native;
+
+// ROM library of the directory the game was loaded from
+ROMLibrary *library;
+int current_rom = -1;
+// The keyboard thread takes over the emulator while the menu is open. F1
+// only asks to quit: the emulation thread tears everything down between
+// frames, nothing is closed under a frame using it.
+pthread_mutex_t emu_lock = PTHREAD_MUTEX_INITIALIZER;
+volatile bool menu_requested = false;
+atomic_bool quit_requested;
+
+// Frame buffer currently shown in the game window. Only the rows that
+// changed since are sent to ncurses.
+uint64_t drawn[GFX_PLANES][GFX_ROWS][2];
+bool drawn_hires, drawn_inverted, drawn_valid;
+
+// Game window backend, NULL when ncurses draws the game
+RenderMode render_mode = RENDER_CURSES;
+Renderer *renderer;
+// Per frame cost of the game window backend (-S)
+bool show_stats = false;
+RenderStats render_stats;
+
+// Clock rate: instructions run per 60 Hz frame (-c, F3/F4). Turbo (-t, F5)
+// runs frames as fast as the host allows and only presents every
+// turbo_skip-th of them; timers still count emulated frames.
+#define IPF_DEFAULT 10
+#define IPF_MAX 100000
+#define TURBO_SKIP 10
+volatile int ipf = IPF_DEFAULT;
+// COSMAC VIP timing (-c vip) paces frames in cycles instead, vip_ipf is how
+// many instructions the last one ran
+volatile bool vip_timing = false;
+int vip_ipf;
+volatile bool turbo = false;
+int turbo_skip = TURBO_SKIP;
+unsigned long frames;
+// Emulated frames per second of real time, refreshed every second
+int frame_rate;
+
+// Spectators watching the game (-s), and headless runs (-H) with no
+// terminal at all, stopping after max_frames frames (-n) if not 0
+Stream *stream;
+bool headless = false;
+unsigned long max_frames;
+
+// Buzzer output (-a), ALSA by default when built with it
+Audio *audio;
+
+// Live metrics for yac8e-stat (-m), NULL when not published. The keyboard
+// thread counts key events, every frame takes them.
+Metrics *metrics;
+unsigned long instructions, presented, late_frames;
+unsigned long instruction_rate;
+atomic_uint key_events;
+
+// Remote debugger (-g). A frame it stopped in the middle of runs the rest of
+// its instructions, frame_left, once resumed.
+Gdb *gdb;
+int frame_left;
+
+// GIF of the presented frames (-o)
+Capture *capture;
+
+// Two player game with another yac8e (-P, -J). The keyboard thread only
+// sets local_keys, netplay gives the CPU those of both players.
+Netplay *netplay;
+volatile uint16_t local_keys;
 
 int main(int argc, char **argv)
 {
 	// Check if ROM was passed and flags
 	char *filename;
-	int DEBUG;
-	if(argc < 2 || argc > 3){
-		printf("Usage: yac8e {-d: debug} <filename>\n");
-		return 1;
-	}
-	else if(argc == 2){ 
-		filename = argv[1];
-		DEBUG = 0;
-	}
-	else if(argc == 3){
-		switch(argv[1][1]){
+	char *capture_path = NULL;
+	char *audio_sink = NULL;
+	char *host_port = NULL, *join_addr = NULL;
+	int DEBUG = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "a:c:dg:HJ:mn:o:P:r:s:St:")) != -1){
+		switch(opt){
+			case 'a':
+				audio_sink = optarg;
+				break;
+			case 'c':
+				if(strcmp(optarg, "vip") == 0){
+					vip_timing = true;
+					break;
+				}
+				ipf = atoi(optarg);
+				if(ipf < 1 || ipf > IPF_MAX){
+					fprintf(stderr, "Clock rate must be vip or 1-%d "
+							"instructions per frame\n", IPF_MAX);
+					return 1;
+				}
+				break;
 			case 'd':
 				DEBUG = 1;
-				filename = argv[2];
 				break;
+			case 'g':
+				gdb = gdb_open(optarg);
+				if(gdb == NULL){
+					perror(optarg);
+					return 1;
+				}
+				break;
+			case 'H':
+				headless = true;
+				break;
+			case 'J':
+				join_addr = optarg;
+				break;
+			case 'm':
+				metrics = metrics_open();
+				if(metrics == NULL){
+					perror("Metrics");
+					return 1;
+				}
+				break;
+			case 'n':
+				max_frames = strtoul(optarg, NULL, 10);
+				break;
+			case 'o':
+				capture_path = optarg;
+				break;
+			case 'P':
+				host_port = optarg;
+				break;
+			case 's':
+				stream = stream_open(optarg);
+				if(stream == NULL){
+					perror(optarg);
+					return 1;
+				}
+				break;
+			case 't':
+				turbo = true;
+				turbo_skip = atoi(optarg);
+				if(turbo_skip < 1){
+					fprintf(stderr, "Turbo must present every 1st frame or more\n");
+					return 1;
+				}
+				break;
+			case 'S':
+				show_stats = true;
+				break;
+			case 'r':
+				{
+				int mode = render_from_name(optarg);
+				if(mode < 0){
+					fprintf(stderr, "Unknown renderer %s\n", optarg);
+					return 1;
+				}
+				render_mode = mode;
+				break;
+				}
 			default:
-				DEBUG = 0;
-				filename = argv[2];
+				optind = argc;
+		}
+	}
+	if(optind != argc - 1){
+		fprintf(stderr, "Usage: yac8e {-d: debug} "
+				"{-r curses|ansi|half|braille} "
+				"{-S: renderer stats} {-c: instructions per frame | vip} "
+				"{-t: turbo, draw every n frames} {-s: stream to socket | port} "
+				"{-H: headless} {-n: stop after n frames} "
+				"{-a: audio to alsa | wav file | -} "
+				"{-m: metrics for yac8e-stat} {-g: gdb server port} "
+				"{-o: record to gif} "
+				"{-P: host netplay on port} {-J: join netplay at [host:]port} "
+				"<filename | rom directory>\n");
+		return 1;
+	}
+	filename = argv[optind];
+	bool netplay_on = host_port != NULL || join_addr != NULL;
+	if(netplay_on && (gdb != NULL || (host_port != NULL && join_addr != NULL))){
+		fprintf(stderr, "Netplay hosts or joins, and doesn't go with the "
+				"debugger\n");
+		return 1;
+	}
+	timing_init();
+	if(headless){
+		DEBUG = 0;
+	} else if(render_mode != RENDER_CURSES){
+		renderer = new_renderer(render_mode);
+	}
+	if(audio_sink != NULL){
+		if(strcmp(audio_sink, "-") == 0 && !headless){
+			fprintf(stderr, "Audio goes to standard output only with -H, the "
+					"game is drawn there\n");
+			return 1;
+		}
+		audio = audio_open(audio_sink);
+		if(audio == NULL){
+			perror(audio_sink);
+			return 1;
+		}
+	}
+	if(capture_path != NULL){
+		// Headless runs keep every frame, games never wait for the encoder
+		capture = capture_open(capture_path, headless);
+		if(capture == NULL){
+			perror(capture_path);
+			return 1;
 		}
 	}
+#ifdef HAVE_ALSA
+	if(audio == NULL && !headless){
+		// Silent if there's no sound card
+		audio = audio_open("alsa");
+	}
+#endif
 
 	// Initialize CPU
 	chip8 = new_cpu();
-	chip8->pc = 0x200;
-
-	// Initialize internal fonts
-	initFonts();	
 
-	// Load ROM
-	FILE *rom = fopen(filename, "rb");
-	assert(rom != NULL);
-
-	fseek(rom, 0, SEEK_END);
-	long lsize = 0;
-	lsize = ftell(rom);
-	rewind(rom);
-
-	// Must load at offset 0x200 of memory
-	size_t n = fread(&chip8->memory[512], 1, lsize, rom);
-	printf("Read %ld bytes from %s\n", n, filename);
-	fclose(rom);
+	// Open the ROM library. A directory starts with the game selection menu,
+	// a single ROM brings in the rest of its directory for later switches.
+	struct stat st;
+	if(stat(filename, &st) < 0){
+		perror(filename);
+		return 1;
+	}
+	bool pick_at_start = S_ISDIR(st.st_mode);
+	if(pick_at_start && (headless || netplay_on)){
+		fprintf(stderr, "%s needs a ROM, not a directory\n",
+				headless ? "Headless mode" : "Netplay");
+		return 1;
+	}
+	char dir[4096], base[4096];
+	snprintf(dir, sizeof(dir), "%s", filename);
+	snprintf(base, sizeof(base), "%s", filename);
+	library = romlib_open(pick_at_start ? filename : dirname(dir),
+			pick_at_start);
+	if(library == NULL){
+		fprintf(stderr, "Could not open ROM library for %s\n", filename);
+		return 1;
+	}
+	if(!pick_at_start){
+		current_rom = romlib_find(library, basename(base));
+		if(current_rom < 0){
+			fprintf(stderr, "%s is not a valid ROM\n", filename);
+			return 1;
+		}
+		load_rom(&library->roms[current_rom]);
+	}
+	if(netplay_on){
+		// Both machines start from the same state: the guest takes the
+		// host's clock rate (0 for VIP timing) and random seed
+		uint64_t hash = library->roms[current_rom].hash;
+		int rate = vip_timing ? 0 : ipf;
+		uint32_t seed = time(NULL);
+		netplay = host_port != NULL ?
+			netplay_host(host_port, hash, &rate, &seed) :
+			netplay_join(join_addr, hash, &rate, &seed);
+		if(netplay == NULL){
+			perror(errno == EPROTO ? "Not the same ROM" : "Netplay");
+			return 1;
+		}
+		vip_timing = rate == 0;
+		ipf = rate > 0 ? rate : ipf;
+		chip8->rng = seed;
+	}
 
-	// Initialize ncurses interface 
-	initGraphics(DEBUG);
+	if(!headless){
+		// Initialize ncurses interface 
+		initGraphics(DEBUG);
 
-	// Create windows
-	createWindows();
+		// Create windows
+		createWindows();
 
-	// Run game loop 
-	int ticks = 0;
+		if(pick_at_start){
+			if(LINES < ROMLIB_MENU_LINES){
+				endwin();
+				fprintf(stderr, "The game selection menu needs a terminal of "
+						"%d lines or more\n", ROMLIB_MENU_LINES);
+				return 1;
+			}
+			current_rom = romlib_pick(library, 0);
+			if(current_rom < 0){
+				end();
+			}
+			load_rom(&library->roms[current_rom]);
+		}
 
-	// Create the keyboard listening thread
-	pthread_t keythread;
-	int pt = pthread_create(&keythread, NULL, updateKeys, (void *)chip8);
-	if(pt) {
-		perror("Failed creating keyboard thread\n");
-		exit(-1);
+		// Create the keyboard listening thread
+		pthread_t keythread;
+		int pt = pthread_create(&keythread, NULL, updateKeys, (void *)chip8);
+		if(pt) {
+			perror("Failed creating keyboard thread\n");
+			exit(-1);
+		}
 	}
 
-	while(1){
-		WINDOW *debug_w = windows[0]; 
-		if(DEBUG){
-			// Erase debug window in preparation for tick data
-			werase(debug_w);
+	// Run game loop, one 60 Hz frame at a time
+	while(!atomic_load(&quit_requested)){
+		// Let the game selection menu run
+		if(menu_requested){
+			usleep(1000);
+			continue;
 		}
-
-		// Run a tick
-		tick(DEBUG);
-		
-		// Draw game window (if necessary)
-		if(chip8->draw){
-			chip8->draw = false;
-			draw();
+		if(gdb != NULL && gdb->stopped){
+			gdb_wait(gdb);
 		}
-			
-		// Draw debug information (if necessary)
-		if(DEBUG){
-			ticks++;
-			mvwprintw(debug_w, 1, 1, 
-					"Window size: %d x %d - ROM Filename: %s", 
-					COLS, LINES, filename);
-			mvwprintw(debug_w, 3, 1, "Ticks: %d", ticks);
-			box(debug_w, 0, 0);
-			wrefresh(debug_w);
+		pthread_mutex_lock(&emu_lock);
+		if(gdb != NULL && !gdb_serve(gdb, chip8)){
+			pthread_mutex_unlock(&emu_lock);
+			break;
+		}
+		// No frame while the debugger keeps the program stopped
+		if(gdb != NULL && gdb->stopped){
+			pthread_mutex_unlock(&emu_lock);
+			continue;
+		}
+		if(gdb != NULL && gdb->patched){
+			// Whatever it wrote may be translated code
+			native = NULL;
+			gdb->patched = false;
+		}
+		frame(DEBUG);
+		pthread_mutex_unlock(&emu_lock);
+		if(max_frames != 0 && frames >= max_frames){
+			break;
 		}
 
+		// Sleep outside the lock, the menu may come in meanwhile
+		pace();
 	}
 	
 	// Destroy graphic interface
@@ -153,25 +400,65 @@ WINDOW *create_newwin(int width, int height, int starty, int startx)
 // Updates graphical interface
 void createWindows()
 {
-	int startx, starty, 
-		d_width, d_height, 
-		g_width, g_height;
+	int d_width, d_height;
 
 	// Debug info window config
 	d_height 	= 7;
 	d_width 	= COLS - 2;
 
-	// Game window config
-	g_height 	= 32;
-	g_width 	= 64;
-
 	// Create the debug info window
 	windows[0] = create_newwin(d_width, d_height, 0, 0);
 
-	// Creates the game window
+	// Creates the game window (low resolution until the ROM asks otherwise)
+	windows[1] = NULL;
+	createGameWindow(64, 32);
+}
+
+// (Re)creates the game window for a screen resolution
+void createGameWindow(int width, int height)
+{
+	int startx, starty, 
+		d_height, 
+		g_width, g_height;
+
+	if(windows[1] != NULL){
+		// Blank the area of the old window before it goes away
+		werase(windows[1]);
+		wrefresh(windows[1]);
+		delwin(windows[1]);
+	}
+
+	// Debug info window config
+	d_height 	= 7;
+
+	// Game window config, cut down to what the terminal can show
+	g_height 	= height;
+	g_width 	= width;
+	if(g_width > COLS){
+		g_width = COLS;
+	}
+	if(g_height > LINES - d_height - 1){
+		g_height = LINES - d_height - 1;
+	}
+
 	startx = (COLS - g_width) / 2;
 	starty = d_height + 1;
 	windows[1] = create_newwin(g_width, g_height, starty, startx);
+	drawn_valid = false;
+
+	// Text renderers draw over the same area, in fewer cells
+	if(renderer != NULL){
+		int cols, rows;
+		render_cells(render_mode, width, height, &cols, &rows);
+		if(cols > COLS){
+			cols = COLS;
+		}
+		if(rows > LINES - d_height - 1){
+			rows = LINES - d_height - 1;
+		}
+		renderer_place(renderer, starty + 1, (COLS - cols) / 2 + 1, cols,
+				rows);
+	}
 }
 
 // Initializes ncurses
@@ -184,590 +471,57 @@ void initGraphics(int DEBUG)
 	windows = malloc(sizeof(WINDOW)*2); // Allocate Windows memory
 }
 
-// Creates a new CPU structure
-CPU *new_cpu()
+// Resets the machine and loads a ROM straight from the library's mapping
+void load_rom(ROM *rom)
 {
-	CPU *cpu = malloc(sizeof(CPU));
-	assert(cpu != NULL);
-	// Zero registers
-	cpu->sp = -1;
-	cpu->pc = 0x0;
-	cpu->I 	= 0x0;
-	// Zero memory
-	memset(&cpu->memory, 0x0, 4096);
-	memset(&cpu->V, 0x0, 16);
-	memset(&cpu->stack, 0x0, 16*sizeof(short));
-	memset(&cpu->gfx, 0x0, 64*32*sizeof(short));
-	// Zero timers
-	cpu->delay_timer = 0;
-	cpu->sound_timer = 0;
-	
-	return cpu;
+	reset_cpu(chip8);
+	int profile = profile_from_name(rom->profile);
+	step = cpu_steps[profile >= 0 ? profile : PROFILE_CHIP48];
+	native = native_find(rom->hash, profile >= 0 ? profile : PROFILE_CHIP48);
+
+	// Must load at offset 0x200 of memory
+	memcpy(&chip8->memory[0x200], rom->data, rom->size);
+	chip8->draw = true;
+	frame_left = 0;
+
+	if(metrics != NULL){
+		metrics_begin(metrics);
+		snprintf(metrics->rom, sizeof(metrics->rom), "%s (%s)", rom->name,
+				rom->profile);
+		metrics_end(metrics);
+	}
 }
 
 void tick(int DEBUG)
 {
-	// Used for tick timer
-	clock_t start = clock(), diff;
-
-	WINDOW *debug_w = windows[0];
+	// No windows in headless mode
+	WINDOW *debug_w = headless ? NULL : windows[0];
 	unsigned short opcode;
 
-	// Update opcode
-	opcode = chip8->memory[chip8->pc] << 8 | chip8->memory[chip8->pc + 1];
-
-	// Decode opcode
-	char mnemonic[128];
-
-	switch(opcode & 0xF000){
-		case 0x0000:
-			switch(opcode & 0x00FF){
-				case 0x00E0:
-					{
-					// Clears the screen.
-					memset(&chip8->gfx, 0x00, sizeof(chip8->gfx));
-					chip8->draw = true;
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "CLR");
-					break;
-					}
-				case 0x00EE:
-					{
-					// Returns from a subroutine. 
-					unsigned short ret_addr = pop_stack(chip8);
-					assert(ret_addr != 0xffff);
-					chip8->pc = ret_addr;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "RET");
-					break;
-					}
-				default:
-					{
-					// 0x0nnn
-					// Jump to a machine code routine at nnn.
-					// This instruction is only used on the old computers on which Chip-8 was originally implemented. It is ignored by modern interpreters.
-					unsigned short NNN = opcode & 0x0FFF;
-					chip8->pc = NNN;
-					snprintf(mnemonic, sizeof(mnemonic), "SYS 0x%03x", NNN);
-					break;
-					/*
-					// 0x0000
-					// #TODO
-					printf("pc: %04x opcode: 0x%04x", chip8->pc, opcode);
-					endwin();
-					exit(-1);
- 					unsigned short NNN = opcode & 0x0FFF;
-					break;
-					*/
-					}
-			};
-			break;
-		case 0x1000:
-			{
-			// Jumps to address NNN.
- 			unsigned short NNN = opcode & 0x0FFF;
-			chip8->pc = NNN;
-
-			// Debug info
-			snprintf(mnemonic, sizeof(mnemonic), "JMP 0x%03x", NNN);
-			break;
-			}
-		case 0x2000:
-			{
-			// Calls subroutine at NNN.
-			unsigned short NNN = opcode & 0x0FFF;
-			bool s = push_stack(chip8->pc+2, chip8);
-			assert(s != false);
-
-			chip8->pc = NNN;
-			
-			// Debug info.
-			snprintf(mnemonic, sizeof(mnemonic), "CALL 0x%03x", NNN);
-			break;
-			}
-		case 0x3000:
-			{
-			// Skips the next instruction if VX equals NN. 
-			// (Usually the next instruction is a jump to skip a code block) 
-			unsigned int X = opcode >> 8 & 0xF;
-			unsigned short NN = opcode & 0x00FF;
-			if(chip8->V[X] == NN){
-				chip8->pc += 4;
-			} else {
-				chip8->pc += 2;
-			}
-
-			// Debug info.
-			snprintf(mnemonic, sizeof(mnemonic), "SEQ V%d, 0x%02x", X, NN);
-			break;
-			}
-		case 0x4000:
-			{
-			// Skips the next instruction if VX doesn't equal NN. (Usually the 
-			// next instruction is a jump to skip a code block) 
-			unsigned int X = opcode >> 8 & 0xF;
-			unsigned short NN = opcode & 0x00FF;
-			if(chip8->V[X] != NN){
-				chip8->pc += 4;
-			} else{
-				chip8->pc += 2;
-			}
-
-			// Debug info.
-			snprintf(mnemonic, sizeof(mnemonic), "SNEQ V%d, 0x%02x", X, NN);
-			break;
-			}
-		case 0x5000:
-			{
-			// Skips the next instruction if VX equals VY. (Usually the next 
-			// instruction is a jump to skip a code block) 
-			unsigned int X = opcode >> 8 & 0xF;
-			unsigned int Y = opcode >> 4 & 0xF;
-			if(chip8->V[X] == chip8->V[Y]){
-				chip8->pc += 4;
-			} else {
-				chip8->pc += 2;
-			}
-			
-			// Debug info.
-			snprintf(mnemonic, sizeof(mnemonic), "SEQ V%d, V%d", X, Y);
-			break;
-			}
-		case 0x6000:
-			{
-			// Sets VX to NN. 
-			unsigned int X = opcode >> 8 & 0xF;
-			unsigned short NN = opcode & 0x00FF;
-
-			chip8->V[X] = NN;
-			chip8->pc += 2;
+	// Update opcode (debug info only, the interpreter decodes on its own)
+	opcode = chip8->memory[chip8->pc] << 8 |
+		chip8->memory[(chip8->pc + 1) & 0xFFFF];
 
-			// Debug info
-			snprintf(mnemonic, sizeof(mnemonic), "STR 0x%02x, V%d", NN, X);
-			break;
-			}
-		case 0x7000:
-			{
-			// Adds NN to VX. (Carry flag is not changed) 
-			unsigned int X = opcode >> 8 & 0xF;
-			unsigned short NN = opcode & 0x00FF;
-
-			chip8->V[X] += NN;
-			chip8->pc += 2;
-
-			// Debug info.
-			snprintf(mnemonic, sizeof(mnemonic), "ADD V%d, 0x%02x", X, NN);
-			break;
-			}
-		case 0x8000:
-			switch(opcode & 0x000F){
-				case 0x0:
-					{
-					// Sets VX to the value of VY. 
-					unsigned int X = opcode >> 8 & 0xF;
-					unsigned int Y = opcode >> 4 & 0xF;
-					chip8->V[X] = chip8->V[Y];
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "STR V%x, V%x", Y, X);
-					break;
-					}
-				case 0x1:
-					{
-					// Sets VX to VX OR VY. (Bitwise OR operation)
-					unsigned int X = opcode >> 8 & 0xF;
-					unsigned int Y = opcode >> 4 & 0xF;
-					chip8->V[X] |= chip8->V[Y];
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "OR V%d, V%d", X, Y);
-					break;
-					}
-				case 0x2:
-					{
-					// Sets VX to VX AND VY. (Bitwise AND operation) 
-					unsigned int X = opcode >> 8 & 0xF;
-					unsigned int Y = opcode >> 4 & 0xF;
-					chip8->V[X] &= chip8->V[Y];
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "AND V%d, V%d", X, Y);
-					break;
-					}
-				case 0x3:
-					{
-					// Sets VX to VX XOR VY. 
-					unsigned int X = opcode >> 8 & 0xF;
-					unsigned int Y = opcode >> 4 & 0xF;
-					chip8->V[X] ^= chip8->V[Y];
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "XOR V%d, V%d", X, Y);
-					break;
-					}
-				case 0x4:
-					{
-					// Adds VY to VX. VF is set to 1 when there's a carry, and 
-					// to 0 when there isn't. 
-					unsigned int X = opcode >> 8 & 0xF;
-					unsigned int Y = opcode >> 4 & 0xF;
-					// Check overflow condition
-					if(chip8->V[X] > 0 && chip8->V[Y] > (0xFF - chip8->V[X])){
-						chip8->V[0xF] = 1;
-					}
-					else {
-						chip8->V[0xF] = 0;
-					}
-					chip8->V[X] += chip8->V[Y];
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "ADD V%d, V%d", X, Y);
-					break;
-					}
-				case 0x5:
-					{
-					// VY is subtracted from VX. VF is set to 0 when there's a 
-					// borrow, and 1 when there isn't. 
-					unsigned int X = opcode >> 8 & 0xF;
-					unsigned int Y = opcode >> 4 & 0xF;
-					// Check overflow condition
-					if(chip8->V[X] < chip8->V[Y]){
-						chip8->V[0xF] = 0;
-					}
-					else {
-						chip8->V[0xF] = 1;
-					}
-					chip8->V[X] -= chip8->V[Y];
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "SUB V%d, V%d", X, Y);
-					break;
-					}
-				case 0x6:
-					{
-					// Stores the least significant bit of VX in VF and then 
-					// shifts VX to the right by 1.
-					unsigned int X = opcode >> 8 & 0xF;
-					chip8->V[0xF] = chip8->V[X] & 0x1;
-					chip8->V[X] >>= 1;
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "SHR V%d, 1", X);
-					break;
-					}
-				case 0x7:
-					{
-					// Sets VX to VY minus VX. VF is set to 0 when there's a 
-					// borrow, and 1 when there isn't. 
-					unsigned int X = opcode >> 8 & 0xF;
-					unsigned int Y = opcode >> 4 & 0xF;
-					if(chip8->V[X] > chip8->V[Y]){
-						chip8->V[0xF] = 0;
-					} else {
-						chip8->V[0xF] = 1;
-					}
-					chip8->V[X] = chip8->V[Y] - chip8->V[X];
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "SUBI V%d, V%d", X, Y);
-					break;
-					}
-				case 0xE:
-					{
-					// Stores the most significant bit of VX in VF and then 
-					// shifts VX to the left by 1.
-					unsigned int X = opcode >> 8 & 0xF;
-					chip8->V[0xF] = chip8->V[X] >> 0x7;
-					chip8->V[X] <<= 1;
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "SHL V%d, 1", X);
-					break;
-					}
-				default:
-					snprintf(mnemonic, sizeof(mnemonic), "UNK OPCODE");
-					printf("panic! opcode: 0x%04x\n", opcode);
-					panic();
-			};
-			break;
-		case 0x9000:
-			{
-			// Skips the next instruction if VX doesn't equal VY. (Usually the 
-			// next instruction is a jump to skip a code block) 
-			unsigned int X = opcode >> 8 & 0xF;
-			unsigned int Y = opcode >> 4 & 0xF;
-			if(chip8->V[X] != chip8->V[Y]){
-				chip8->pc += 4;
-			} else {
-				chip8->pc += 2;
-			}
-
-			// Debug info.
-			snprintf(mnemonic, sizeof(mnemonic), "SNEQ V%d, V%d", X, Y);
-			break;
-			}
-		case 0xa000:
-			{
-			// Sets I to the address NNN.
-			unsigned short NNN = opcode & 0x0FFF;
-			chip8->I = NNN;
-			chip8->pc += 2;
-
-			// Debug info
-			snprintf(mnemonic, sizeof(mnemonic), "MSTR 0x%03x", NNN);
-			break;
-			}
-		case 0xb000:
-			{
-			// Jumps to the address NNN plus V0. 
-			unsigned short NNN = opcode & 0x0FFF;
-			chip8->pc = chip8->V[0] + NNN;
-
-			// Debug info.
-			snprintf(mnemonic, sizeof(mnemonic), "JMPA V0, 0x%03x", NNN);
-			break;
-			}
-		case 0xc000:
-			{
-		  	// Sets VX to the result of a bitwise and operation on a random 
-		  	// number (Typically: 0 to 255) and NN. 
-			unsigned int X = opcode >> 8 & 0x0F;	
-			unsigned short NN = opcode & 0xFF;
-			unsigned int r = rand() % 0xFF;
-			
-			chip8->V[X] = r & NN;
-			chip8->pc += 2;
-			
-			// Debug info.
-			snprintf(mnemonic, sizeof(mnemonic), "RAND 0x%02x", NN);
-			break;
-			}
-		case 0xd000:
-			{
-			// Draws a sprite at coordinate (VX, VY) that has a width of 8 
-			// pixels and a height of N+1 pixels. Each row of 8 pixels is read 
-			// as bit-coded starting from memory location I; I value doesn’t 
-			// change after the execution of this instruction. As described 
-			// above, VF is set to 1 if any screen pixels are flipped from set 
-			// to unset when the sprite is drawn, and to 0 if that doesn’t 
-			// happen 
-			unsigned short x = chip8->V[opcode >> 8 & 0xF]; 
-			unsigned short y = chip8->V[opcode >> 4 & 0xF]; 
-			unsigned short N = opcode & 0xF;
-			unsigned short pixel_line;
-
-			chip8->V[0xF] = 0;
-			for(int ydepth = 0; ydepth < N; ydepth++){
-				pixel_line = chip8->memory[chip8->I + ydepth];
-				for(int xline = 0; xline < 8; xline++){
-					if((pixel_line & (0x80 >> xline)) != 0){
-						if(chip8->gfx[(x + xline + ((y + ydepth) * 64))] == 1){
-							chip8->V[0xF] = 1;
-						}
-						chip8->gfx[x + xline + ((y + ydepth) * 64)] ^= 1;
-					}
-				}
-			}
-			chip8->draw = true;
-			chip8->pc += 2;
-			
-			// Debug info.
-			snprintf(mnemonic, sizeof(mnemonic), "DRAW");
-			break;
-			}
-		case 0xe000:
-			switch(opcode & 0xFF){
-				case 0x9E:
-					{
-					// Skips the next instruction if the key stored in VX is 
-					// pressed. (Usually the next instruction is a jump to skip
-					// a code block) 
-					unsigned int X = opcode >> 8 & 0xF;
-					if(chip8->input[chip8->V[X]] != 0x0){
-						chip8->pc += 4;
-					} else {
-						chip8->pc += 2;
-					}
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "SKP V%d", X);
-					break;
-					}
-				case 0xA1:
-					{
-					// Skips the next instruction if the key stored in VX isn't
-					// pressed. (Usually the next instruction is a jump to skip
-					// a code block) 
-					unsigned int X = opcode >> 8 & 0xF;
-					if(chip8->input[chip8->V[X]] == 0x0){
-						chip8->pc += 4;
-					} else {
-						chip8->pc += 2;
-					}
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "SKNP V%d", X);
-					break;
-					}
-				default:
-					snprintf(mnemonic, sizeof(mnemonic), "UNK OPCODE");
-					printf("panic! opcode: 0x%04x\n", opcode);
-					panic();
-			}
-			break;
-		case 0xf000:
-			switch(opcode & 0x00FF){
-				case 0x0007:
-					{
-					// Sets VX to the value of the delay timer. 
-					unsigned int X = opcode >> 8 & 0xF;
-					chip8->V[X] = chip8->delay_timer;
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "TIME V%d, delay", X);
-					break;
-					}
-				case 0x000A:
-					{
-					// A key press is awaited, and then stored in VX. 
-					// (Blocking Operation. All instruction halted until 
-					// next key event)  
-					unsigned int X = opcode >> 8 & 0xF;
-					while(chip8->key_is_pressed == false){
-					}
-					for(int k = 0; k < 16; k++){
-						if(chip8->input[k] != 0x0){
-							chip8->V[X] = k;
-						}
-					}
-					chip8->pc+= 2;
-					
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "LD V%d, K", X);
-					break;
-					}
-				case 0x0015:
-					{
-					// Sets the delay timer to VX.. 
-					unsigned int X = opcode >> 8 & 0xF;
-					chip8->delay_timer = chip8->V[X];
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "TIME delay, V%d", X);
-					break;
-					}
-				case 0x0018:
-					{
-					// Sets the sound timer to VX.  
-					unsigned int X = opcode >> 8 & 0xF;
-					chip8->sound_timer = chip8->V[X];
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "SNDT V%d", X);
-					break;
-					}
-				case 0x001e:
-					{
-					// Adds VX to I. VF is not affected. 
-					unsigned int X = opcode >> 8 & 0xF;
-					chip8->I += chip8->V[X]; 
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "MEMA V%d", X);
-					break;
-					}
-				case 0x0029:
-					{
-					// Sets I to the location of the sprite for the character
-					// in VX. Characters 0-F (in hexadecimal) are represented 
-					// by a 4x5 font. 
-					unsigned int X = opcode >> 8 & 0xF;
-					chip8->I = chip8->V[X] << 4;
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "CHAR V%d", X);
-					break;
-					}
-				case 0x0033:
-					{
-					// Stores the binary-coded decimal representation of VX, 
-					// with the most significant of three digits at the address 
-					// in I, the middle digit at I plus 1, and the least 
-					// significant digit at I plus 2. (In other words, take the
-					// decimal representation of VX, place the hundreds digit 
-					// in memory at location in I, the tens digit at location 
-					// I+1, and the ones digit at location I+2.)
-					unsigned int X = opcode >> 8 & 0x0F;
-					chip8->memory[chip8->I]	 = chip8->V[X] / 100;
-					chip8->memory[chip8->I+1] = (chip8->V[X] % 100) / 10;
-					chip8->memory[chip8->I+2] = chip8->V[X] % 10;
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "BCD V%d", X);
-					break;
-
-					};
-				case 0x0055:
-					{
-					// Stores V0 to VX (including VX) in memory starting at 
-					// address I. The offset from I is increased by 1 for each 
-					// value written, but I itself is left unmodified.
-					unsigned int X = opcode >> 8 & 0x0F;
-					for(int i = 0; i <= X; i++){
-						chip8->memory[chip8->I + i] = chip8->V[i];
-					}
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "REGD V0-V%d", X);
-					break;
-
-					}
-				case 0x0065:
-					{
-					// Fills V0 to VX (including VX) with values from memory 
-					// starting at address I. The offset from I is increased by
-					// 1 for each value written, but I itself is left 
-					// unmodified.
-					unsigned int X = opcode >> 8 & 0xF;
-					for(int i = 0; i <= X; i++){
-						chip8->V[i] = chip8->memory[chip8->I + i];
-					}
-
-					chip8->pc += 2;
-
-					// Debug info.
-					snprintf(mnemonic, sizeof(mnemonic), "LDR V0-V%d", X);
-					break;
-					}
+	// Every path to the interpreter comes here (debugger, VIP timing, single
+	// steps): a store into translated code retires the translation
+	if(native != NULL && native_clobbers(native, chip8)){
+		native = NULL;
+	}
 
-				default:
-					snprintf(mnemonic, sizeof(mnemonic), "UNK OPCODE");
-					printf("panic! opcode: 0x%04x\n", opcode);
-					panic();
-			}
-			break;
-		}	
+	// Run the instruction through the profile's interpreter
+	if(!step(chip8)){
+		if(chip8->exit){
+			end();
+		}
+		fprintf(stderr, "panic! opcode: 0x%04x\n", opcode);
+		panic();
+	}
 
 	if(DEBUG){
+		// Decode opcode
+		char mnemonic[128];
+		disasm(opcode, mnemonic, sizeof(mnemonic));
+
 		// Update debug info
 		mvwprintw(debug_w, 4, 1, "opcode: %04x Mnemonic: %s", opcode, mnemonic);
 		mvwprintw(debug_w, 5, 1, "PC+2: %04x I: 0x%04x V0: 0x%02x V1: 0x%02x\
@@ -781,83 +535,412 @@ void tick(int DEBUG)
 	 chip8->input[0xb], chip8->input[0xc], chip8->input[0xd], chip8->input[0xe],\
 	 chip8->input[0xf], chip8->key_is_pressed);
 	}
+}
+
+// Runs one 60 Hz frame: ipf instructions (or VIP cycles), then the timers.
+// The game window is presented when it changed (every turbo_skip frames in
+// turbo).
+void frame(int DEBUG)
+{
+	WINDOW *debug_w = headless ? NULL : windows[0];
+	uint64_t start = metrics != NULL ? metrics_now() : 0;
+	bool present = !turbo || frames % turbo_skip == 0;
+	// Debug info only matters for the last instruction shown
+	bool debug = DEBUG && present;
+
+	if(debug){
+		// Erase debug window in preparation for tick data
+		werase(debug_w);
+	}
+	int clock = ipf;
+	int n = clock;
+	if(frame_left > 0){
+		n = frame_left;
+		frame_left = 0;
+	}
+	int budget = n;
+	if(gdb_armed(gdb)){
+		// Every instruction goes by the breakpoints and watchpoints, only
+		// while there are some (ipf of them, even with VIP timing)
+		while(n > 0 && !gdb_before(gdb, chip8)){
+			tick(n == 1 && debug);
+			n--;
+			if(gdb_after(gdb, chip8)){
+				break;
+			}
+		}
+		if(n > 0){
+			// Stopped: the program is shown as it is, the timers wait for
+			// the rest of the frame
+			frame_left = n;
+			instructions += budget - n;
+			if(chip8->draw && !headless){
+				chip8->draw = false;
+				draw();
+			}
+			return;
+		}
+	}
+	instructions += budget - n;
+	if(netplay != NULL){
+		// Netplay runs the frame with both players' keys, and may run the
+		// last few again. Nothing happens while the other player lags.
+		if(!netplay_advance(netplay, chip8, local_keys, simulate)){
+			return;
+		}
+	} else {
+		run(n, debug);
+	}
+	frames++;
+
+	// The buzzer sounds for the whole frame while the sound timer runs
+	// (under netplay, the timers already went down)
+	if(audio != NULL){
+		audio_frame(audio, chip8);
+	}
+	if(netplay == NULL){
+		timers(debug);
+	}
 
-	// Decrement timers
-	if(chip8->delay_timer > 0){ 
+	uint64_t emulated = metrics != NULL ? metrics_now() : 0;
+	if(!present){
+		record_frame(start, emulated);
+		return;
+	}
+	presented++;
+
+	// Draw game window (if necessary), spectators get every presented frame
+	bool changed = chip8->draw;
+	chip8->draw = false;
+	if(stream != NULL){
+		stream_publish(stream, chip8, changed);
+	}
+	if(capture != NULL && changed){
+		capture_frame(capture, chip8, frames);
+	}
+	if(changed && !headless){
+		draw();
+	}
+
+	// Draw debug information (if necessary)
+	if(debug){
+		mvwprintw(debug_w, 1, 1, 
+				"Window size: %d x %d - ROM: %s (%s)", 
+				COLS, LINES, library->roms[current_rom].name,
+				library->roms[current_rom].profile);
+		if(vip_timing){
+			clock = vip_ipf;
+		}
+		mvwprintw(debug_w, 3, 1, "Frames: %lu - Clock: %d ipf (%d Hz)%s%s "
+				"x%.1f", frames, clock, clock * 60, vip_timing ? " VIP" : "",
+				turbo ? " turbo" : "", frame_rate / 60.0);
+		if(show_stats && render_stats.frames > 0){
+			wprintw(debug_w, " - Render %s: %lu B/frame %lu us/frame",
+					render_names[render_mode],
+					render_stats.bytes / render_stats.frames,
+					render_stats.build_ns / render_stats.frames / 1000);
+		}
+		box(debug_w, 0, 0);
+		wrefresh(debug_w);
+	}
+	record_frame(start, emulated);
+}
+
+// Runs n instructions of a frame, the last one shown in the debug window,
+// or a frame of cycles with VIP timing. Translated code first (not while
+// debugging, every instruction is shown), the interpreter takes over
+// wherever it can't go.
+void run(int n, int DEBUG)
+{
+	if(n == 0){
+		return;
+	}
+	if(vip_timing){
+		vip_ipf = run_vip(DEBUG);
+		instructions += vip_ipf;
+		return;
+	}
+	instructions += n;
+	if(native != NULL && !DEBUG){
+		bool stale = false;
+		while(n > 0 && native != NULL &&
+				(n = native->run(chip8, n, &stale)) > 0){
+			if(stale){
+				native = NULL;
+				break;
+			}
+			tick(0);
+			n--;
+		}
+	}
+	for(; n > 1; n--){
+		tick(0);
+	}
+	if(n > 0){
+		tick(DEBUG);
+	}
+}
+
+// Runs instructions until their cycles take up the frame, or one waits for
+// the display. What a frame goes over by comes out of the next one, so the
+// clock never drifts. Returns how many ran. Translated code doesn't count
+// cycles, the interpreter runs them all.
+int run_vip(int DEBUG)
+{
+	int count = 0;
+	chip8->cycles += VIP_BUDGET;
+	while(chip8->cycles > 0){
+		unsigned short opcode = chip8->memory[chip8->pc] << 8 |
+			chip8->memory[(chip8->pc + 1) & 0xFFFF];
+		chip8->cycles -= vip_cycles[opcode];
+		tick(DEBUG);
+		count++;
+		if(vip_waits(opcode)){
+			// The sprite went out during the blank, the rest of the frame
+			// was spent waiting for it
+			chip8->cycles = -vip_cycles[opcode];
+			break;
+		}
+	}
+	return count;
+}
+
+// Decrements the timers at the end of a frame
+void timers(int DEBUG)
+{
+	if(chip8->delay_timer > 0){
 		chip8->delay_timer--;
 	}
 	if(chip8->sound_timer > 0) {
 		chip8->sound_timer--;
-		mvwprintw(debug_w, 2, 1, "BEEP!");
+		if(DEBUG){
+			mvwprintw(windows[0], 2, 1, "BEEP!");
+		}
 	}
+}
+
+// A whole frame for netplay, which only ever runs chip8
+void simulate(CPU *cpu)
+{
+	assert(cpu == chip8);
+	run(ipf, 0);
+	timers(0);
+}
 
-	// Each tick should take (at least) 1/60s
-	// 16ms per tick seemed too slow... decreased it to 1.6ms
-	bool tick_end = false;
-	while(tick_end == false){
-		diff = clock() - start;
-		float msec = diff * 1000 / CLOCKS_PER_SEC;
-		if(msec >= 5) tick_end = true;
-	}	
+// Publishes the metrics of the frame that started at start and was done
+// running instructions at emulated (drawing took the rest)
+void record_frame(uint64_t start, uint64_t emulated)
+{
+	static uint64_t last_start;
+	if(metrics == NULL){
+		return;
+	}
+	uint64_t now = metrics_now();
+	unsigned int keys = atomic_exchange(&key_events, 0);
+
+	metrics_begin(metrics);
+	metrics->instructions = instructions;
+	metrics->ips = instruction_rate;
+	metrics->frames = frames;
+	metrics->presented = presented;
+	metrics->frame_rate = frame_rate;
+	metrics->ipf = vip_timing ? vip_ipf : ipf;
+	metrics->turbo = turbo;
+	metrics->emulate_ns += emulated - start;
+	metrics->draw_ns += now - emulated;
+	metrics->late = late_frames;
+	metrics->stream_dropped = stream != NULL ? stream->dropped : 0;
+	metrics->audio_dropped = audio != NULL ? audio->overruns : 0;
+	metrics->keys += keys;
+	metrics->input_depth = keys;
+	if(keys > metrics->input_max){
+		metrics->input_max = keys;
+	}
+	if(last_start != 0){
+		metrics->histogram[metrics_bucket(start - last_start)]++;
+	}
+	metrics_end(metrics);
+	last_start = start;
+}
 
+// Waits for the next 60 Hz frame (no wait in turbo)
+void pace()
+{
+	static struct timespec next, second;
+	static unsigned long second_frames, second_instructions;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	// Measure the real speed once per second
+	if((now.tv_sec - second.tv_sec) * 1000000000L +
+			(now.tv_nsec - second.tv_nsec) >= 1000000000L){
+		frame_rate = frames - second_frames;
+		second_frames = frames;
+		instruction_rate = instructions - second_instructions;
+		second_instructions = instructions;
+		second = now;
+	}
 
+	if(turbo){
+		next = now;
+		return;
+	}
+	next.tv_nsec += 1000000000L / 60;
+	if(next.tv_nsec >= 1000000000L){
+		next.tv_nsec -= 1000000000L;
+		next.tv_sec++;
+	}
+	// Don't try to catch up after a stall (menu, slow terminal)
+	long late = (now.tv_sec - next.tv_sec) * 1000000000L +
+		(now.tv_nsec - next.tv_nsec);
+	if(late > 0 && frames > 1){
+		late_frames++;
+	}
+	if(late > 1000000000L / 60){
+		next = now;
+		return;
+	}
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
 }
 
 void draw()
 {
-	WINDOW *game_w = windows[1];
-	werase(game_w);
-	for(int i = 0; i < 32*64; i++){
-		if(chip8->gfx[i] == 1){
-			if(chip8->sound_timer > 0){
-				wprintw(game_w, " ");
-			} else {
-				waddch(game_w, ACS_CKBOARD);
-			}
-		} else {
-			if(chip8->sound_timer > 0){
-				waddch(game_w, ACS_CKBOARD);
-			} else {
-				wprintw(game_w, " ");
-			}
+	struct timespec t0, t1;
+	unsigned long bytes = 0;
+	if(show_stats){
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if(renderer == NULL){
+			bytes = written_bytes();
 		}
 	}
-	//box(game_w, 0, 0);
-	wrefresh(game_w);
+
+	int width = SCREEN_WIDTH(chip8);
+	int height = SCREEN_HEIGHT(chip8);
+	// The screen is inverted while the buzzer sounds
+	int inverted = chip8->sound_timer > 0;
+
+	if(chip8->hires != drawn_hires){
+		createGameWindow(width, height);
+		drawn_hires = chip8->hires;
+	}
+	if(renderer != NULL){
+		renderer_draw(renderer, chip8, inverted);
+	} else {
+		drawCurses(width, height, inverted);
+	}
+
+	// ncurses writes on its own, count what this thread sent to the terminal
+	if(show_stats){
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		render_stats.frames++;
+		render_stats.bytes += renderer != NULL ? renderer->size :
+			written_bytes() - bytes;
+		render_stats.build_ns += (t1.tv_sec - t0.tv_sec) * 1000000000L +
+			(t1.tv_nsec - t0.tv_nsec);
+	}
 }
 
-bool push_stack(unsigned short value, CPU *cpu)
+// Draws the game window through ncurses
+void drawCurses(int width, int height, int inverted)
 {
-	if(cpu->sp >= 0xFF){
-		return false;
+	if(inverted != drawn_inverted){
+		drawn_valid = false;
+		drawn_inverted = inverted;
 	}
-	cpu->sp++;
-	cpu->stack[cpu->sp] = value;
-	return true;
+
+	// One glyph per colour (plane 1, plane 2, both planes)
+	chtype glyphs[4] = { ' ', ACS_CKBOARD, ACS_BOARD, ACS_BLOCK };
+	chtype line[128];
+
+	WINDOW *game_w = windows[1];
+	for(int y = 0; y < height; y++){
+		if(drawn_valid &&
+				memcmp(drawn[0][y], chip8->gfx[0][y], sizeof(drawn[0][y])) == 0 &&
+				memcmp(drawn[1][y], chip8->gfx[1][y], sizeof(drawn[1][y])) == 0){
+			continue;
+		}
+		for(int x = 0; x < width; x++){
+			line[x] = glyphs[gfx_pixel(chip8, x, y) ^ inverted];
+		}
+		mvwaddchnstr(game_w, y, 0, line, width);
+		memcpy(drawn[0][y], chip8->gfx[0][y], sizeof(drawn[0][y]));
+		memcpy(drawn[1][y], chip8->gfx[1][y], sizeof(drawn[1][y]));
+	}
+	drawn_valid = true;
+	wrefresh(game_w);
 }
 
-unsigned short pop_stack(CPU *cpu)
+// Bytes written by the emulation thread so far (ncurses doesn't say what it
+// sends). The audio, capture and keyboard threads write at the same time,
+// their bytes are left out.
+unsigned long written_bytes()
 {
-	if(cpu->sp == -1){
-		return 0xffff;
+	static int fd = -1;
+	if(fd < 0){
+		fd = open("/proc/thread-self/io", O_RDONLY);
+	}
+	char buf[512];
+	ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+	if(n <= 0){
+		return 0;
 	}
-	unsigned short ret = cpu->stack[cpu->sp];
-	cpu->sp--;
-	return ret;
+	buf[n] = '\0';
+	char *wchar = strstr(buf, "wchar: ");
+	return wchar != NULL ? strtoul(wchar + 7, NULL, 10) : 0;
 }
 
 void end()
 {
-	endwin();
-	pthread_exit(NULL);
-	free(windows);
-	free(chip8);
+	if(!headless){
+		endwin();
+	}
+	if(show_stats && render_stats.frames > 0){
+		fprintf(stderr, "Renderer %s: %lu frames, %lu B/frame, "
+				"%lu us/frame\n",
+				render_names[render_mode], render_stats.frames,
+				render_stats.bytes / render_stats.frames,
+				render_stats.build_ns / render_stats.frames / 1000);
+	}
+	if(show_stats && stream != NULL){
+		fprintf(stderr, "Stream: %d viewers, %lu frames dropped\n",
+				stream->count, stream->dropped);
+	}
+	if(show_stats && audio != NULL){
+		fprintf(stderr, "Audio: %lu frames dropped, %lu silences\n",
+				audio->overruns, audio->underruns);
+	}
+	if(show_stats && capture != NULL){
+		fprintf(stderr, "Capture: %lu frames dropped\n", capture->dropped);
+	}
+	if(show_stats && netplay != NULL){
+		fprintf(stderr, "Netplay: %lu rollbacks, %lu frames replayed, "
+				"%lu stalls, %lu desyncs\n", netplay->rollbacks, netplay->replayed,
+				netplay->stalls, netplay->desyncs);
+	}
+	stream_close(stream);
+	audio_close(audio);
+	capture_close(capture, frames);
+	metrics_close(metrics);
+	gdb_close(gdb);
+	netplay_close(netplay);
+	// The keyboard thread may still be waiting for a key
 	exit(0);
 }
 
+// A keypad key is down until the next key event, or none for a while
+void press(int key)
+{
+	if(netplay != NULL){
+		local_keys |= 1 << key;
+		return;
+	}
+	chip8->input[key] = 0x1;
+	chip8->key_is_pressed = true;
+}
+
 void panic()
 {
-	printf("PANIC! PC: %04x", chip8->pc);
+	fprintf(stderr, "PANIC! PC: %04x", chip8->pc);
 	end();
 }
 
@@ -869,75 +952,118 @@ void *updateKeys(void* cpu){
 		// this is a hack and I hate it...
 		key = getch();
 		timeout(150);
+		if(key != ERR){
+			atomic_fetch_add(&key_events, 1);
+		}
+		// Both machines must run the same game at the same clock rate
+		if(netplay != NULL && key >= KEY_F(2) && key <= KEY_F(5)){
+			continue;
+		}
 		switch(key){
 			case KEY_F(1): // F1 pressed. Close program
-				end();
+				atomic_store(&quit_requested, true);
+				return NULL;
+			case KEY_F(2): // F2 pressed. Game selection menu
+				{
+				menu_requested = true;
+				pthread_mutex_lock(&emu_lock);
+				int pick = romlib_pick(library, current_rom);
+				if(pick >= 0){
+					current_rom = pick;
+					load_rom(&library->roms[current_rom]);
+				}
+				touchwin(windows[0]);
+				touchwin(windows[1]);
+				wnoutrefresh(windows[0]);
+				wnoutrefresh(windows[1]);
+				doupdate();
+				// The menu went over the game, draw it again
+				if(renderer != NULL){
+					renderer->clear = true;
+				}
+				chip8->draw = true;
+				pthread_mutex_unlock(&emu_lock);
+				menu_requested = false;
+				break;
+				}
+			case KEY_F(3): // F3 pressed. Slower clock
+				if(vip_timing){
+					// From the speed the game ran at
+					ipf = vip_ipf > 0 ? vip_ipf : ipf;
+					vip_timing = false;
+				}
+				ipf = ipf > 1 ? ipf - ipf / 5 - 1 : 1;
+				if(ipf < 1){
+					ipf = 1;
+				}
+				break;
+			case KEY_F(4): // F4 pressed. Faster clock
+				if(vip_timing){
+					// From the speed the game ran at
+					ipf = vip_ipf > 0 ? vip_ipf : ipf;
+					vip_timing = false;
+				}
+				ipf = ipf + ipf / 4 + 1 < IPF_MAX ? ipf + ipf / 4 + 1 : IPF_MAX;
+				break;
+			case KEY_F(5): // F5 pressed. Turbo on/off
+				turbo = !turbo;
+				// Whatever was skipped shows up at the next frame
+				chip8->draw = true;
+				break;
 			case 49:
-				chip8->input[0x1] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0x1);
 				break;
 			case 50:
-				chip8->input[0x2] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0x2);
 				break;
 			case 51:
-				chip8->input[0x3] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0x3);
 				break;
 			case 52:
-				chip8->input[0xC] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0xC);
 				break;
 			case 113:
-				chip8->input[0x4] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0x4);
 				break;
 			case 119:
-				chip8->input[0x5] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0x5);
 				break;
 			case 101:
-				chip8->input[0x6] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0x6);
 				break;
 			case 114:
-				chip8->input[0xD] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0xD);
 				break;
 			case 97:
-				chip8->input[0x7] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0x7);
 				break;
 			case 115:
-				chip8->input[0x8] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0x8);
 				break;
 			case 100:
-				chip8->input[0x9] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0x9);
 				break;
 			case 102:
-				chip8->input[0xE] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0xE);
 				break;
 			case 122:
-				chip8->input[0xA] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0xA);
 				break;
 			case 120:
-				chip8->input[0x0] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0x0);
 				break;
 			case 99:
-				chip8->input[0xB] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0xB);
 				break;
 			case 118:
-				chip8->input[0xF] = 0x1;
-				chip8->key_is_pressed = true;
+				press(0xF);
 				break;
 			default:
 			case ERR:
+				if(netplay != NULL){
+					local_keys = 0;
+					break;
+				}
 				chip8->key_is_pressed = false;
 				for(int k = 0; k < 16; k++){
 					chip8->input[k] = 0;
@@ -946,30 +1072,3 @@ void *updateKeys(void* cpu){
 		}
 	}
 }
-
-void initFonts()
-{
-	// Initializes the emulator's default fonts (0-F)
-	// located at addresses 0x0000 to 0x00F5
-	char characters[] = { 0xF0,0x90,0x90,0x90,0xF0,
-						0x20,0x60,0x20,0x20,0x70,
-						0xF0,0x10,0xF0,0x80,0xF0, 
-						0xF0,0x10,0xF0,0x10,0xF0, 
-						0x90,0x90,0xF0,0x10,0x10, 
-						0xF0,0x80,0xF0,0x10,0xF0, 
-						0xF0,0x80,0xF0,0x90,0xF0, 
-						0xF0,0x10,0x20,0x40,0x40, 
-						0xF0,0x90,0xF0,0x90,0xF0, 
-						0xF0,0x90,0xF0,0x10,0xF0, 
-						0xF0,0x90,0xF0,0x90,0x90, 
-						0xE0,0x90,0xE0,0x90,0xE0, 
-						0xF0,0x80,0x80,0x80,0xF0, 
-						0xE0,0x90,0x90,0x90,0xE0, 
-						0xF0,0x80,0xF0,0x80,0xF0, 
-						0xF0,0x80,0xF0,0x80,0x80};
-
-	for(int i = 0; i <= 0xF; i++){
-		memcpy(&chip8->memory[i << 4], &characters[i*5], 5);
-	};
-}
-